@@ -0,0 +1,140 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+*/
+
+/*
+  Compares the actions stored in a std::function (action_t) with
+  the actions stored inline (action_fn): first the cost of invoking
+  them, then a grammar with an action per token. The number of
+  memory allocations is reported for both. Finally, a grammar with
+  a heavier action per token runs the actions on the parsing thread
+  and on the consumer thread of the context (async actions), e.g.
+
+      ./bench_actions 200000
+
+  uses an input of 200000 tokens (the default is 20000).
+*/
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+#include <tinyparser.hpp>
+
+using namespace std;
+using namespace tipa;
+
+static unsigned long long allocations = 0;
+
+void *operator new(size_t n)
+{
+    allocations++;
+    if (void *p = malloc(n)) return p;
+    throw bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+template<typename F>
+static void measure(const string &name, F f)
+{
+    auto a = allocations;
+    auto t = chrono::steady_clock::now();
+    long r = f();
+    chrono::duration<double, milli> d = chrono::steady_clock::now() - t;
+    cout << name << ": " << d.count() << " ms, "
+         << allocations - a << " allocations (result " << r << ")" << endl;
+}
+
+// an action capturing three references, as typical grammar actions
+template<typename A>
+static long dispatch(long n)
+{
+    long sum = 0, count = 0, last = 0;
+    parser_context pc;
+    vector<A> acts;
+    for (int i = 0; i < 16; i++)
+        acts.push_back(A([&sum, &count, &last](parser_context &) { sum += ++count; last = count; }));
+    for (long i = 0; i < n; i++) acts[i & 15](pc);
+    return sum + last;
+}
+
+template<typename A>
+static long parse(const string &input)
+{
+    long sum = 0, count = 0, last = 0;
+    rule num = rule(tk_int);
+    rule id = rule(tk_ident);
+    A a = [&sum, &count, &last](parser_context &pc) { sum += pc.read_token().size(); count++; last = sum; };
+    num.set_action(a);
+    id.set_action(a);
+    rule list = *(num | id | rule(','));
+
+    stringstream str(input);
+    parser_context pc;
+    pc.set_stream(str);
+    if (!parse_all(list, pc)) cout << "parse error" << endl;
+    return sum + count + last;
+}
+
+// an action that does some work on the text of each token
+static long parse_heavy(const string &input, bool async)
+{
+    unsigned long h = 0;
+    rule num = rule(tk_int);
+    rule id = rule(tk_ident);
+    async_action_fn a = [&h](token_span s) {
+        for (int k = 0; k < 50; k++)
+            for (char c : s[0].second) h = h * 31 + c + k;
+    };
+    num.set_async_action(a);
+    id.set_async_action(a);
+    rule list = *(num | id | rule(','));
+
+    stringstream str(input);
+    parser_context pc;
+    pc.set_async_actions(async);
+    pc.set_stream(str);
+    if (!parse_all(list, pc)) cout << "parse error" << endl;
+    return long(h & 0xffff);
+}
+
+int main(int argc, char *argv[])
+{
+    long n = argc > 1 ? atol(argv[1]) : 20000;
+
+    measure("dispatch, action_t ", [n]() { return dispatch<action_t>(n * 1000); });
+    measure("dispatch, action_fn", [n]() { return dispatch<action_fn>(n * 1000); });
+
+    string input;
+    for (long i = 0; i < n; i++) {
+        input += (i % 2) ? "x" + to_string(i) : to_string(i);
+        input += (i % 10 == 9) ? ",\n" : ", ";
+    }
+
+    measure("parsing, action_t ", [&input]() { return parse<action_t>(input); });
+    measure("parsing, action_fn", [&input]() { return parse<action_fn>(input); });
+
+    measure("heavy actions, sync ", [&input]() { return parse_heavy(input, false); });
+    measure("heavy actions, async", [&input]() { return parse_heavy(input, true); });
+}
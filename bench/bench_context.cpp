@@ -0,0 +1,131 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+  
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+
+/*
+  Parses many short inputs, creating a parser context for each one,
+  reusing the same context, and taking it from the context pool, and
+  counts the memory allocations done for each input. Then, the
+  inputs are read from a new stringstream (as in most examples), and
+  directly from the string. E.g.
+
+      ./bench_context 100000
+
+  parses 100000 inputs (the default is 50000).
+*/
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+#include <tinyparser.hpp>
+
+using namespace std;
+using namespace tipa;
+
+static long allocations = 0;
+
+void *operator new(size_t n)
+{
+    ++allocations;
+    if (void *p = malloc(n)) return p;
+    throw bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+typedef enum {CTX_NEW, CTX_REUSE, CTX_POOL, CTX_STREAM, CTX_INPUT, CTX_PARSE_ALL} ctx_mode;
+
+static void run(const string &name, const vector<string> &inputs, ctx_mode mode)
+{
+    rule value = rule(tk_int) | rule(tk_ident);
+    rule pair = rule(tk_ident) >> rule('=') >> value;
+    rule root = sep_list_rule(pair) >> rule(';');
+    long n = 0;
+    pair.set_action([&n](parser_context &) { n++; });
+
+    parser_context shared;
+    stringstream str;
+    long failed = 0;
+    long allocs = 0;
+    auto t = chrono::steady_clock::now();
+    for (auto &s : inputs) {
+        // the stream is not counted
+        str.str(s);
+        str.clear();
+        long a = allocations;
+        switch (mode) {
+        case CTX_NEW: {
+            parser_context pc;
+            pc.set_stream(str);
+            if (!parse_all(root, pc)) failed++;
+            break;
+        }
+        case CTX_REUSE:
+            shared.set_stream(str);
+            if (!parse_all(root, shared)) failed++;
+            break;
+        case CTX_POOL: {
+            auto pc = context_pool::local().acquire();
+            pc->set_stream(str);
+            if (!parse_all(root, *pc)) failed++;
+            break;
+        }
+        case CTX_STREAM: {
+            stringstream in(s);
+            shared.set_stream(in);
+            if (!parse_all(root, shared)) failed++;
+            break;
+        }
+        case CTX_INPUT:
+            shared.set_input(s);
+            if (!parse_all(root, shared)) failed++;
+            break;
+        case CTX_PARSE_ALL:
+            if (!parse_all(root, string_view(s))) failed++;
+            break;
+        }
+        allocs += allocations - a;
+    }
+    chrono::duration<double> d = chrono::steady_clock::now() - t;
+    cout << name << ": " << d.count() * 1000 << " ms, "
+         << double(allocs) / inputs.size() << " allocations per input ("
+         << n << " pairs, " << failed << " failures)" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    long n = argc > 1 ? atol(argv[1]) : 50000;
+
+    vector<string> inputs;
+    for (long i = 0; i < n; i++)
+        inputs.push_back("a = " + to_string(i) + ", b = x" + to_string(i % 10) + ";");
+
+    run("new context   ", inputs, CTX_NEW);
+    run("same context  ", inputs, CTX_REUSE);
+    run("context pool  ", inputs, CTX_POOL);
+    run("stringstream  ", inputs, CTX_STREAM);
+    run("set_input     ", inputs, CTX_INPUT);
+    run("parse_all     ", inputs, CTX_PARSE_ALL);
+}
@@ -0,0 +1,138 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+*/
+
+/*
+  Throughput of the numeric conversions: std::stoi()/std::stod()
+  (as convert_to() used to do) against the convert_to() functions,
+  then a numeric-heavy input parsed with read_all(), and a list of
+  integers parsed with sep_list_rule() and number_list_rule(), e.g.
+
+      ./bench_convert 1000000
+
+  converts one million integers and one million doubles (the
+  default is 2000000).
+*/
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+#include <tinyparser.hpp>
+
+using namespace std;
+using namespace tipa;
+
+template<typename F>
+static void measure(const string &name, size_t bytes, F f)
+{
+    auto t = chrono::steady_clock::now();
+    double r = f();
+    chrono::duration<double> d = chrono::steady_clock::now() - t;
+    cout << name << ": " << d.count() * 1000 << " ms, "
+         << bytes / d.count() / 1e6 << " MB/s (result " << r << ")" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    long n = argc > 1 ? atol(argv[1]) : 2000000;
+
+    vector<string> ints, reals;
+    size_t ibytes = 0, rbytes = 0;
+    for (long i = 0; i < n; i++) {
+        ints.push_back(to_string(i * 7919 % 1000003));
+        reals.push_back(to_string(i * 0.37));
+        ibytes += ints.back().size();
+        rbytes += reals.back().size();
+    }
+
+    measure("int, stoi        ", ibytes, [&ints]() {
+            long s = 0;
+            for (auto &x : ints) s += stoi(x);
+            return s;
+        });
+    measure("int, convert_to  ", ibytes, [&ints]() {
+            long s = 0;
+            int v = 0;
+            for (auto &x : ints) { convert_to(x, v); s += v; }
+            return s;
+        });
+    measure("double, stod     ", rbytes, [&reals]() {
+            double s = 0;
+            for (auto &x : reals) s += stod(x);
+            return s;
+        });
+    measure("double, convert_to", rbytes, [&reals]() {
+            double s = 0, v = 0;
+            for (auto &x : reals) { convert_to(x, v); s += v; }
+            return s;
+        });
+
+    // a numeric-heavy file, parsed with read_vars()
+    string input;
+    for (long i = 0; i < n / 100; i++)
+        input += ints[i] + " " + reals[i] + (i % 8 == 7 ? "\n" : " ");
+
+    measure("parsing          ", input.size(), [&input]() {
+            int x;
+            double y, s = 0;
+            token tk_real = create_lib_token("^[+-]?\\d+(\\.\\d*)?");
+            rule pair = rule(tk_int) >> rule(tk_real);
+            pair.set_action([&](parser_context &pc) {
+                    if (read_all(pc, x, y)) s += x + y;
+                });
+            rule all = *pair;
+            stringstream str(input);
+            parser_context pc;
+            pc.set_stream(str);
+            if (!parse_all(all, pc)) cout << pc.get_formatted_err_msg();
+            return s;
+        });
+
+    // a list of integers, parsed by the general rules and by
+    // number_list_rule()
+    string list;
+    for (long i = 0; i < n / 10; i++) list += ints[i] + (i % 16 == 15 ? ",\n" : ", ");
+    list += "0";
+
+    measure("list, sep_list_rule   ", list.size(), [&list]() {
+            vector<int> v;
+            rule num = rule(tk_int);
+            num.set_action([&v](parser_context &pc) { int x; read_all(pc, x); v.push_back(x); });
+            rule l = sep_list_rule(num);
+            stringstream str(list);
+            parser_context pc;
+            pc.set_stream(str);
+            if (!parse_all(l, pc)) cout << pc.get_formatted_err_msg();
+            return v.size();
+        });
+    measure("list, number_list_rule", list.size(), [&list, n]() {
+            vector<int> v;
+            v.reserve(n / 10 + 1);
+            rule l = number_list_rule(v);
+            stringstream str(list);
+            parser_context pc;
+            pc.set_stream(str);
+            if (!parse_all(l, pc)) cout << pc.get_formatted_err_msg();
+            return v.size();
+        });
+}
@@ -0,0 +1,106 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+*/
+
+/*
+  Parses a file of assignments ("key12 = 12;") read with an
+  std::ifstream, and then with an async_input on its file
+  descriptor, e.g.
+
+      ./bench_input 64 /tmp/big.txt
+
+  generates a file of 64 MB (the default is 16) if the file does
+  not exist (the default is a temporary file, removed at the end).
+  The gain of the async_input is larger when the file is not in
+  the page cache, or comes from a slow device.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <tinyparser.hpp>
+#include <async_input.hpp>
+
+using namespace std;
+using namespace tipa;
+
+static long parse(istream &in)
+{
+    long items = 0;
+    rule item = rule(tk_ident) >> rule('=') >> rule(tk_int) >> rule(';');
+    item.set_action([&items](parser_context &pc) { pc.collect_tokens(); items++; });
+    rule root = *item;
+
+    parser_context pc;
+    pc.set_streaming(true);
+    pc.set_stream(in);
+    if (!parse_all(root, pc)) cout << "parse error" << endl;
+    return items;
+}
+
+template<typename F>
+static void measure(const string &name, double mb, F f)
+{
+    auto t = chrono::steady_clock::now();
+    long r = f();
+    chrono::duration<double> d = chrono::steady_clock::now() - t;
+    cout << name << ": " << d.count() << " s (" << mb / d.count() << " MB/s), "
+         << r << " items" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long long mb = argc > 1 ? strtoull(argv[1], nullptr, 10) : 16;
+    string name = argc > 2 ? argv[2] : "/tmp/tipa_bench_input.txt";
+    bool temporary = argc <= 2;
+
+    if (temporary || access(name.c_str(), R_OK) != 0) {
+        ofstream out(name);
+        unsigned long long size = mb * 1024 * 1024, written = 0;
+        for (unsigned long long i = 0; written < size; i++) {
+            string l = "key" + to_string(i) + " = " + to_string(i) + ";\n";
+            out << l;
+            written += l.size();
+        }
+    }
+
+    measure("ifstream   ", mb, [&name]() {
+            ifstream in(name);
+            return parse(in);
+        });
+    measure("async_input", mb, [&name]() {
+            int fd = open(name.c_str(), O_RDONLY);
+            if (fd < 0) { perror(name.c_str()); return 0L; }
+            long r;
+            {
+                async_istream in(fd);
+                r = parse(in);
+            }
+            close(fd);
+            return r;
+        });
+
+    if (temporary) remove(name.c_str());
+}
@@ -0,0 +1,82 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+  
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+
+/*
+  A grammar that backtracks a lot (each statement is tried as an
+  assignment, then as a call, then as an expression), parsed
+  directly on the input, in pretokenized mode, and in pipelined mode
+  (the input is split by another thread), e.g.
+
+      ./bench_pretok 10000
+
+  parses 10000 statements (the default is 20000).
+*/
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+
+#include <tinyparser.hpp>
+
+using namespace std;
+using namespace tipa;
+
+static void run(const string &name, const string &input, bool pretok, bool pipelined = false)
+{
+    rule expr, primary, call, assign, stmt;
+    primary = rule(tk_int) | rule(tk_ident) | (rule('(') >> expr >> rule(')'));
+    expr = primary >> *((rule('+') | rule('-')) >> primary);
+    call = rule(tk_ident) >> rule('(') >> -(expr >> *(rule(',') >> expr)) >> rule(')');
+    assign = rule(tk_ident) >> rule('=') >> expr;
+    stmt = (assign | call | expr) >> rule(';');
+    long n = 0;
+    stmt.set_action([&n](parser_context &pc) { n += pc.collect_tokens().size(); });
+    rule root = *stmt;
+
+    auto t = chrono::steady_clock::now();
+    stringstream str(input);
+    parser_context pc;
+    pc.set_stream(str);
+    if (pretok) pc.pretokenize({ tk_ident, tk_int }, pipelined);
+    if (!parse_all(root, pc)) cout << pc.get_formatted_err_msg();
+    chrono::duration<double> d = chrono::steady_clock::now() - t;
+    cout << name << ": " << d.count() * 1000 << " ms, "
+         << input.size() / d.count() / 1e6 << " MB/s (" << n << " tokens)" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    long n = argc > 1 ? atol(argv[1]) : 20000;
+
+    string input;
+    for (long i = 0; i < n; i++) {
+        switch (i % 3) {
+        case 0: input += "x" + to_string(i) + " = (a + " + to_string(i) + ") - b;\n"; break;
+        case 1: input += "f(x, " + to_string(i) + " + y, (z));\n"; break;
+        case 2: input += "a + b - (c + " + to_string(i) + ");\n"; break;
+        }
+    }
+
+    run("on the input  ", input, false);
+    run("pretokenized  ", input, true);
+    run("pipelined     ", input, true, true);
+}
@@ -0,0 +1,97 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+  
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+
+/*
+  Parses a log, one record per line: with a new stringstream for each
+  line, with set_input() on the same context, and with a
+  record_parser and an increasing number of workers, e.g.
+
+      ./bench_records 1000000
+
+  parses 1000000 lines (the default is 200000).
+*/
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+#include <tinyparser.hpp>
+#include <records.hpp>
+
+using namespace std;
+using namespace tipa;
+
+static void report(const string &name, const string &input, chrono::steady_clock::time_point t, long ok)
+{
+    chrono::duration<double> d = chrono::steady_clock::now() - t;
+    cout << name << ": " << d.count() * 1000 << " ms, "
+         << input.size() / d.count() / 1e6 << " MB/s (" << ok << " records)" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    long n = argc > 1 ? atol(argv[1]) : 200000;
+
+    string input;
+    for (long i = 0; i < n; i++)
+        input += to_string(1600000000 + i) + " host" + to_string(i % 13) + " GET /index" + 
+            to_string(i % 100) + " 200 " + to_string(i % 4096) + "\n";
+
+    rule path = rule('/') >> rule(tk_ident);
+    rule line = rule(tk_int) >> rule(tk_ident) >> rule(tk_ident) >> path >> rule(tk_int) >> rule(tk_int);
+
+    {
+        auto t = chrono::steady_clock::now();
+        long ok = 0;
+        stringstream all(input);
+        string l;
+        while (getline(all, l)) {
+            stringstream str(l);
+            parser_context pc;
+            pc.set_stream(str);
+            ok += parse_all(line, pc);
+        }
+        report("stringstream   ", input, t, ok);
+    }
+    {
+        auto t = chrono::steady_clock::now();
+        long ok = 0;
+        parser_context pc;
+        string_view v(input);
+        while (!v.empty()) {
+            auto e = v.find('\n');
+            pc.set_input(v.substr(0, e));
+            ok += parse_all(line, pc);
+            v.remove_prefix(e + 1);
+        }
+        report("set_input      ", input, t, ok);
+    }
+    unsigned hw = max(1u, thread::hardware_concurrency());
+    for (unsigned w = 1; w <= hw; w *= 2) {
+        auto t = chrono::steady_clock::now();
+        long ok = 0;
+        record_parser p(line, w);
+        p.parse(string_view(input), [&ok](record_result &r) { ok += r.ok; });
+        report("records, " + to_string(w) + (w < 10 ? "    " : "   ") + "", input, t, ok);
+    }
+}
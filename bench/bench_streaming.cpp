@@ -0,0 +1,110 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+
+/*
+  Parses a generated input of the given size (in MB, default 16) in
+  streaming mode, and prints the peak memory used by the process
+  while the parsing advances. The peak must not grow with the size
+  of the input, e.g.
+
+      ./bench_streaming 5120
+
+  parses 5 GB in the same memory as 16 MB.
+*/
+
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <sys/resource.h>
+
+#include <tinyparser.hpp>
+
+using namespace std;
+using namespace tipa;
+
+/* A stream buffer that generates lines like "key12 = 12;" until
+   the requested number of bytes has been produced */
+class generator_buf : public streambuf {
+    unsigned long long size;
+    unsigned long long produced;
+    unsigned long long count;
+    string line;
+public:
+    generator_buf(unsigned long long s) : size(s), produced(0), count(0) {}
+    unsigned long long get_produced() const { return produced; }
+protected:
+    int_type underflow() {
+        if (produced >= size) return traits_type::eof();
+        line = "key" + to_string(count) + " = " + to_string(count) + ";\n";
+        count++;
+        produced += line.size();
+        setg(&line[0], &line[0], &line[0] + line.size());
+        return traits_type::to_int_type(line[0]);
+    }
+};
+
+static long peak_rss_kb()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long long mb = 16;
+    if (argc > 1) mb = strtoull(argv[1], nullptr, 10);
+    unsigned long long size = mb * 1024 * 1024;
+
+    generator_buf buf(size);
+    istream input(&buf);
+
+    unsigned long long items = 0, next_report = size / 10;
+    rule item = rule(tk_ident) >> rule('=') >> rule(tk_int) >> rule(';');
+    item.set_action([&](parser_context &pc) {
+            pc.collect_tokens();
+            items++;
+            if (buf.get_produced() >= next_report) {
+                cout << "  " << buf.get_produced() / (1024 * 1024) << " MB parsed, "
+                     << "retained lines: " << pc.retained_lines() << ", "
+                     << "peak RSS: " << peak_rss_kb() << " KB" << endl;
+                next_report += size / 10;
+            }
+        });
+    rule root = *item;
+
+    parser_context pc;
+    pc.set_streaming(true);
+    pc.set_stream(input);
+
+    cout << "Parsing " << mb << " MB in streaming mode" << endl;
+    auto t0 = chrono::steady_clock::now();
+    bool f = parse_all(root, pc);
+    auto t1 = chrono::steady_clock::now();
+    double secs = chrono::duration<double>(t1 - t0).count();
+
+    cout << "Result      : " << boolalpha << f << endl;
+    cout << "Items       : " << items << endl;
+    cout << "Time        : " << secs << " s (" << mb / secs << " MB/s)" << endl;
+    cout << "Peak RSS    : " << peak_rss_kb() << " KB" << endl;
+    return f ? 0 : 1;
+}
@@ -121,19 +121,23 @@ public:
 
 int main()
 {
-    // These are the parsing rules
-    rule expr, primary, term, 
-        op_plus, op_minus, op_mult, op_div, r_int, r_var;
-    
-    // An expression is sequence of terms separated by + or -
-    expr = term >> *(op_plus | op_minus);
-    op_plus = rule('+') >> term;    
-    op_minus = rule('-') >> term;
+    // The following is used to build the syntax tree, 
+    // which is used later for the calculations
+    builder b; 
+    using namespace std::placeholders;
 
-    // A term is a sequence of primaries, separated by * or /
-    term = primary >> *(op_mult | op_div);
-    op_mult = rule('*') >> primary;
-    op_div = rule('/') >> primary;
+    // These are the parsing rules
+    rule expr, primary, r_int, r_var;
+
+    // An expression is a sequence of primaries separated by
+    // operators: * and / have higher precedence than + and -, and
+    // all of them are left associative
+    expr = operator_table_rule(primary, {
+            {'+', OP_LEFT, 10, std::bind(&builder::make_op<plus_node>,  &b, _1)},
+            {'-', OP_LEFT, 10, std::bind(&builder::make_op<minus_node>, &b, _1)},
+            {'*', OP_LEFT, 20, std::bind(&builder::make_op<mult_node>,  &b, _1)},
+            {'/', OP_LEFT, 20, std::bind(&builder::make_op<div_node>,   &b, _1)}
+        });
 
     // A primary is either an integer or an expression within parenthesis
     primary = r_int | r_var |
@@ -144,17 +148,8 @@ int main()
 
     r_var = rule(tk_ident);
     
-    // The following is used to build the syntax tree, 
-    // which is used later for the calculations
-    builder b; 
-    using namespace std::placeholders;
-    
     r_var.   set_action(std::bind(&builder::make_var,            &b, _1));
     r_int.   set_action(std::bind(&builder::make_leaf,           &b, _1));
-    op_plus. set_action(std::bind(&builder::make_op<plus_node>,  &b, _1));
-    op_minus.set_action(std::bind(&builder::make_op<minus_node>, &b, _1));
-    op_mult. set_action(std::bind(&builder::make_op<mult_node>,  &b, _1));
-    op_div.  set_action(std::bind(&builder::make_op<div_node>,   &b, _1));
 
     /*****************************************************/
 
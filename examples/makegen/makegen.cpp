@@ -61,20 +61,19 @@ rule create_grammar()
         -std::move(inc_rule) >> -std::move(lib_rule) >>
         rule('}');
         
-    exec_rule.set_action( ([] (parser_context &pc){
-                vector<string> v;
-                pc.collect_tokens(back_inserter(v));                
+    // the action receives all the tokens of the exec block at once
+    exec_rule.set_span_action( ([] (parser_context &pc, token_span v){
                 Executable exec;
                 unsigned i = 0;
                 while (i < v.size()) { 
-                    if (v[i] == "name") get<0>(exec) = v[++i];
-                    else if (v[i] == "lib") get<2>(exec) = v[++i];
-                    else if (v[i] == "include") get<3>(exec) = v[++i];
-                    else if (v[i] == "srcs") {
+                    if (v[i].second == "name") get<0>(exec) = v[++i].second;
+                    else if (v[i].second == "lib") get<2>(exec) = v[++i].second;
+                    else if (v[i].second == "include") get<3>(exec) = v[++i].second;
+                    else if (v[i].second == "srcs") {
                         ++i;
                         while (i < v.size()) {
-                            if (v[i] != "lib" and v[i] != "include")
-                                get<1>(exec).push_back(v[i++]);
+                            if (v[i].second != "lib" and v[i].second != "include")
+                                get<1>(exec).push_back(v[i++].second);
                             else break;
                         }
                     }
@@ -83,7 +82,9 @@ rule create_grammar()
                 all_execs.push_back(exec);
             }));
 
-    rule root_rule = std::move(global_rule) >> *(std::move(exec_rule));
+    // once an exec block has been parsed, there is no need to
+    // backtrack into it: the cut releases the memory
+    rule root_rule = std::move(global_rule) >> *(std::move(exec_rule) >> cut());
     
     return root_rule;
 }
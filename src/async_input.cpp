@@ -0,0 +1,139 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+*/
+#include "async_input.hpp"
+#include "tinyparser.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+
+namespace tipa {
+
+    async_input::async_input(std::istream &in, std::size_t block_size) :
+        in(&in), fd(-1), bsize(block_size)
+    {
+        start();
+    }
+
+    async_input::async_input(int fd, std::size_t block_size) :
+        in(nullptr), fd(fd), bsize(block_size)
+    {
+#ifdef POSIX_FADV_SEQUENTIAL
+        // only a hint: it fails on pipes, for example
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        start();
+    }
+
+    void async_input::start()
+    {
+        if (bsize == 0) throw parse_exc("async_input: the block size must be positive");
+        for (int i = 0; i < 2; i++) {
+            blocks[i].resize(bsize);
+            len[i] = 0;
+            full[i] = false;
+        }
+        cur = -1;
+        at_end = false;
+        stop = false;
+        th = std::thread([this]() { run(); });
+    }
+
+    async_input::~async_input()
+    {
+        {
+            std::lock_guard<std::mutex> lk(m);
+            stop = true;
+        }
+        cv.notify_all();
+        th.join();
+    }
+
+    std::size_t async_input::read_block(char *p)
+    {
+        if (in) {
+            in->read(p, bsize);
+            if (in->bad()) throw parse_exc("async_input: error while reading the stream");
+            return in->gcount();
+        }
+        while (true) {
+            // a short read is used as it is, so that the parser can
+            // go on with the data already available (e.g. a pipe)
+            ssize_t n = ::read(fd, p, bsize);
+            if (n >= 0) return n;
+            if (errno != EINTR)
+                throw parse_exc(std::string("async_input: ") + std::strerror(errno));
+        }
+    }
+
+    void async_input::run()
+    {
+        int i = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lk(m);
+                cv.wait(lk, [this, i]() { return stop || !full[i]; });
+                if (stop) return;
+            }
+            // the block is not used by the parser
+            std::size_t n = 0;
+            std::exception_ptr e;
+            try {
+                n = read_block(blocks[i].data());
+            } catch (...) {
+                e = std::current_exception();
+            }
+            {
+                std::lock_guard<std::mutex> lk(m);
+                len[i] = n;
+                error = e;
+                full[i] = true;
+            }
+            cv.notify_all();
+            if (n == 0) return;
+            i ^= 1;
+        }
+    }
+
+    async_input::int_type async_input::underflow()
+    {
+        if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+        if (at_end) return traits_type::eof();
+
+        std::unique_lock<std::mutex> lk(m);
+        // gives the consumed block back to the reader
+        if (cur >= 0) {
+            full[cur] = false;
+            cv.notify_all();
+        }
+        cur = (cur + 1) & 1;
+        cv.wait(lk, [this]() { return full[cur]; });
+        if (len[cur] == 0) {
+            at_end = true;
+            setg(nullptr, nullptr, nullptr);
+            if (error) std::rethrow_exception(error);
+            return traits_type::eof();
+        }
+        char *p = blocks[cur].data();
+        setg(p, p, p + len[cur]);
+        return traits_type::to_int_type(*p);
+    }
+}
@@ -0,0 +1,111 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef __ASYNC_INPUT_HPP__
+#define __ASYNC_INPUT_HPP__
+
+#include <istream>
+#include <streambuf>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+/// default size of the blocks read by an async_input (1 MB)
+#define TIPA_INPUT_BLOCK (1u << 20)
+
+namespace tipa {
+
+    /**
+       A stream buffer that reads its source (a std::istream or a
+       file descriptor) on a background thread, in blocks of
+       block_size bytes, into two buffers: while the parser consumes
+       one block, the next one is being read, so that the parser
+       does not stop at each I/O stall. For a file descriptor, the
+       kernel is told that the file is read sequentially
+       (posix_fadvise()), so that it reads ahead as well.
+
+       The lexer reads it as any other stream:
+
+       \code
+       async_input buf(fd);
+       std::istream in(&buf);
+       pc.set_stream(in);
+       \endcode
+
+       or, more simply, with an async_istream. The source must not
+       be used by anyone else while the async_input exists (a file
+       descriptor is not closed by it). If reading the source fails,
+       the exception is thrown by the read that reaches that point,
+       so the istream gets the badbit, and the lexer throws a
+       parse_exc. The destructor waits for the read in progress, if
+       any.
+     */
+    class async_input : public std::streambuf {
+    public:
+        explicit async_input(std::istream &in, std::size_t block_size = TIPA_INPUT_BLOCK);
+        explicit async_input(int fd, std::size_t block_size = TIPA_INPUT_BLOCK);
+        ~async_input();
+
+        async_input(const async_input &) = delete;
+        async_input &operator=(const async_input &) = delete;
+
+        std::size_t block_size() const { return bsize; }
+    protected:
+        int_type underflow() override;
+    private:
+        std::istream *in;
+        int fd;
+        std::size_t bsize;
+
+        // the two blocks, and the bytes read in each one (0 at the
+        // end of the input)
+        std::vector<char> blocks[2];
+        std::size_t len[2];
+        // full[i] is true from when the reader has filled block i to
+        // when the parser has consumed it
+        bool full[2];
+        // the block read by the parser (-1 before the first one)
+        int cur;
+        bool at_end;
+        bool stop;
+        std::exception_ptr error;
+
+        std::mutex m;
+        std::condition_variable cv;
+        std::thread th;
+
+        void start();
+        std::size_t read_block(char *p);
+        void run();
+    };
+
+    /// An istream reading from an async_input
+    class async_istream : public std::istream {
+        async_input buf;
+    public:
+        explicit async_istream(std::istream &in, std::size_t block_size = TIPA_INPUT_BLOCK) :
+            std::istream(nullptr), buf(in, block_size) { rdbuf(&buf); }
+        explicit async_istream(int fd, std::size_t block_size = TIPA_INPUT_BLOCK) :
+            std::istream(nullptr), buf(fd, block_size) { rdbuf(&buf); }
+    };
+}
+
+#endif
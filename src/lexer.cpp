@@ -23,6 +23,7 @@
 #include "log_macros.hpp"
 
 #include <regex>
+#include <algorithm>
 #include <lexer.hpp>
 
 using namespace std;
@@ -48,7 +49,8 @@ namespace tipa {
         return token(++index, reg_ex);
     }
     
-    lexer::lexer() 
+    lexer::lexer() : p_input(nullptr), view_pos(0), view_eof(true), first_line(0), cut_depth(0), streaming(false), max_lookback(0),
+                     eof_hit(false), open_line(false), cache_next(0), cache_hits(0)
     {
     }
 
@@ -61,18 +63,77 @@ namespace tipa {
         array.push_back(token(name, expr));
     }
 
-    void lexer::set_stream(istream &in)
+    void lexer::reset()
     {
+        // a few lines are enough to start the next input, the others
+        // would keep the memory of a long input
+        for (auto &l : all_lines) {
+            if (spare_lines.size() >= LEX_SPARE_LINES) break;
+            spare_lines.push_back(std::move(l));
+        }
         all_lines.clear();
-        while (!saved_ctx.empty()) saved_ctx.pop();
+        first_line = 0;
+        saved_ctx.clear();
+        cut_depth = 0;
 
-        p_input = &in;
+        p_input = nullptr;
+        view = std::string_view();
+        view_pos = 0;
+        view_eof = true;
         nline = 0;
         ncol = 0;
-	
+        eof_hit = false;
+        open_line = false;
+        // line 0 is never read: the entries (and their strings) are
+        // reused by the next input
+        for (auto &e : cache) e.nl = 0;
+        cache_next = 0;
+        cache_hits = 0;
+    }
+
+    void lexer::set_stream(istream &in)
+    {
+        reset();
+        p_input = &in;
         next_line();
     }
 
+    void lexer::set_input(std::string_view s)
+    {
+        reset();
+        view = s;
+        view_eof = false;
+        next_line();
+    }
+
+    bool lexer::read_line(std::string &s)
+    {
+        if (p_input) {
+            getline(*p_input, s);
+            // a read error (e.g. of an async_input) is not the end
+            // of the input: the lexer would wait for more forever
+            if (p_input->bad()) throw parse_exc("Lexer: error while reading the input stream");
+            return p_input->fail();
+        }
+        auto nl = view.find('\n', view_pos);
+        if (nl == std::string_view::npos) {
+            bool empty = view_pos == view.size();
+            s.assign(view.data() + view_pos, view.size() - view_pos);
+            view_pos = view.size();
+            view_eof = true;
+            return empty;
+        }
+        s.assign(view.data() + view_pos, nl - view_pos);
+        view_pos = nl + 1;
+        return false;
+    }
+
+    void lexer::set_streaming(bool flag, std::size_t max_lines)
+    {
+        streaming = flag;
+        max_lookback = max_lines;
+    }
+
     void lexer::set_comment(const std::string &b, const std::string &e, const std::string &sl)
     {
         comment_begin = b;
@@ -86,24 +147,39 @@ namespace tipa {
             skip_spaces();
             if (start != curr_line.end()) return false;
         } while (next_line());
-        return ((start == curr_line.end()) && (nline == all_lines.size()) && p_input->eof());
+        return ((start == curr_line.end()) && (nline == first_line + all_lines.size()) && input_eof());
     }
     
     bool lexer::next_line()
     {
-        if (nline == all_lines.size()) {
-            if (p_input->eof()) {
+        if (nline == first_line + all_lines.size()) {
+            if (input_eof()) {
                 return false;
             }
-            getline(*p_input, curr_line);
-            all_lines.push_back(curr_line);
+            if (open_line) {
+                // the last line was empty because the input ended
+                // there, and now the stream has been extended: the
+                // line continues with the new input
+                open_line = read_line(all_lines.back());
+                curr_line = all_lines.back();
+                start = curr_line.begin();
+                return true;
+            }
+            open_line = read_line(curr_line);
+            if (streaming) release_lines();
+            if (spare_lines.empty()) all_lines.push_back(curr_line);
+            else {
+                all_lines.push_back(std::move(spare_lines.back()));
+                spare_lines.pop_back();
+                all_lines.back() = curr_line;
+            }
         } else {
-            if (nline > all_lines.size())
+            if (nline > first_line + all_lines.size())
                 throw parse_exc("Lexer: exceeding all_lines array lenght!");
         }
     
         nline++;
-        curr_line = all_lines[nline-1];
+        curr_line = all_lines[nline-1-first_line];
         ncol = 0;
         start = curr_line.begin();	
         return true;
@@ -114,26 +190,69 @@ namespace tipa {
         ctx c;
         c.nl = nline; 
         c.nc = ncol;
-        if (start == curr_line.end()) c.dist = -1;
-        else c.dist = std::distance(curr_line.begin(), start);
+        c.dist = std::distance(curr_line.begin(), start);
+
+        saved_ctx.push_back(c);
+    }
 
-        saved_ctx.push(c);
+    bool lexer::released_saved() const
+    {
+        return saved_ctx.size() > cut_depth && saved_ctx.back().nl <= first_line;
     }
 
-    void lexer::restore()
+    bool lexer::restore()
     {
-        ctx c = saved_ctx.top();
-        saved_ctx.pop();
-        nline = c.nl;
+        // the stack stays as the parser's one
+        if (released_saved())
+            throw parse_exc("Lexer: cannot go back to line " + std::to_string(saved_ctx.back().nl) +
+                            ", it has been released (lookback too short)");
+        ctx c = saved_ctx.back();
+        saved_ctx.pop_back();
+        if (saved_ctx.size() < cut_depth) {
+            cut_depth = saved_ctx.size();
+            return false;
+        }
         ncol = c.nc;
-        curr_line = all_lines[nline-1];
-        if (c.dist < 0) start = curr_line.end();
-        else start = curr_line.begin() + c.dist;
+        // often we go back on the same line: no need to copy it
+        if (c.nl != nline) {
+            nline = c.nl;
+            curr_line = all_lines[nline-1-first_line];
+        }
+        start = curr_line.begin() + c.dist;
+        return true;
     }
 
     void lexer::discard_saved()
     {
-        saved_ctx.pop();
+        saved_ctx.pop_back();
+        if (saved_ctx.size() < cut_depth) cut_depth = saved_ctx.size();
+    }
+
+    /*
+      Called before reading a new line. The saved contexts have
+      non-decreasing positions, so the oldest live context is the
+      first one after the committed ones.
+    */
+    void lexer::release_lines()
+    {
+        unsigned keep = nline;
+        if (saved_ctx.size() > cut_depth) keep = std::min(keep, saved_ctx[cut_depth].nl);
+        if (max_lookback > 0 and nline > max_lookback)
+            keep = std::max(keep, unsigned(nline - max_lookback));
+        while (first_line + 1 < keep) {
+            all_lines.pop_front();
+            first_line++;
+        }
+    }
+
+    void lexer::commit()
+    {
+        cut_depth = saved_ctx.size();
+        // no context can go back before the current line
+        while (first_line + 1 < nline) {
+            all_lines.pop_front();
+            first_line++;
+        }
     }
 
     void lexer::advance_start(int n)
@@ -197,36 +316,90 @@ namespace tipa {
     }
 
 
+    std::string_view lexer::peek_line()
+    {
+        if (not skip_spaces()) {
+            eof_hit = true;
+            return std::string_view();
+        }
+        return std::string_view(&*start, distance(start, curr_line.end()));
+    }
+
+    void lexer::consume(std::size_t n)
+    {
+        advance_start(n);
+        skip_spaces();
+    }
+
     token_val lexer::try_token(const token &x)
     {
-        static std::match_results<std::string::iterator> what;
+        string res;
+        token_val tv = try_token(x, [&res](std::string_view v) { res = v; });
+        if (tv.first == x.get_name()) tv.second = std::move(res);
+        return tv;
+    }
+
+    token_val lexer::try_token(const token &x, const std::function<void(std::string_view)> &fun)
+    {
+        static thread_local std::match_results<std::string::iterator> what;
 
-        if (not skip_spaces()) return { LEX_ERROR, "EOF" }; 
+        if (not skip_spaces()) {
+            eof_hit = true;
+            return { LEX_ERROR, "EOF" };
+        }
 
-        std::regex expr(x.get_expr());
-        auto flag = std::regex_search(start, curr_line.end(), what, expr, 
-                                      std::regex_constants::match_continuous);
+        // the same token is often tried again at the same position
+        // (e.g. by the alternatives of a rule)
+        std::size_t off = distance(curr_line.begin(), start);
+        long len = -1;
+        bool found = false;
+        for (auto &e : cache) 
+            if (e.nl == nline && e.off == off && e.id == x.get_name() && e.expr == x.get_expr()) {
+                len = e.len;
+                found = true;
+                cache_hits++;
+                break;
+            }
 
-        if (flag) {
-            string res;
-            copy(start, what[0].second, back_inserter(res));
-            advance_start(distance(start, what[0].second));
+        if (!found) {
+            if (std::regex_search(start, curr_line.end(), what, x.get_regex(), 
+                                  std::regex_constants::match_continuous))
+                len = distance(start, what[0].second);
+            if (cache.size() < LEX_CACHE_SIZE) 
+                cache.push_back({nline, off, x.get_name(), x.get_expr(), len});
+            else {
+                // assigned field by field, to reuse the string
+                auto &e = cache[cache_next];
+                e.nl = nline;
+                e.off = off;
+                e.id = x.get_name();
+                e.expr = x.get_expr();
+                e.len = len;
+                cache_next = (cache_next + 1) % LEX_CACHE_SIZE;
+            }
+        }
+
+        if (len >= 0) {
+            fun(std::string_view(&*start, len));
+            advance_start(len);
             skip_spaces();
-            return token_val(x.get_name(), res);
+            return token_val(x.get_name(), "");
         }
         else return { LEX_ERROR, "Token does not match" };
     }
 
-    std::pair<token_id, std::string> ahead_lexer::get_token()
+    token_val lexer::next_token(const std::vector<token> &tokens)
     {
-        static std::match_results<std::string::iterator> what;
+        static thread_local std::match_results<std::string::iterator> what;
 
-        if (not skip_spaces()) return { LEX_ERROR, "EOF" }; 
+        if (not skip_spaces()) {
+            eof_hit = true;
+            return { LEX_ERROR, "EOF" };
+        }
 
         // try to identify which token
-        for (auto x : array) {
-            std::regex expr(x.get_expr());
-            auto flag = std::regex_search(start, curr_line.end(), what, expr, 
+        for (auto &x : tokens) {
+            auto flag = std::regex_search(start, curr_line.end(), what, x.get_regex(), 
                                           std::regex_constants::match_continuous);
             if (flag) {
                 string res;
@@ -239,10 +412,17 @@ namespace tipa {
         return { LEX_ERROR, "Unknown token" };
     }
 
+    std::pair<token_id, std::string> ahead_lexer::get_token()
+    {
+        return next_token(array);
+    }
+
     std::string lexer::extract_line()
     {
         std::string s(start, curr_line.end());
-        next_line(); skip_spaces();
+        // at the end of the input, there is no next line
+        advance_start(s.size());
+        if (next_line()) skip_spaces();
         return s;
     }
 
@@ -253,8 +433,10 @@ namespace tipa {
         for (;;) {
             // move to the first non empty line
             while (start == curr_line.end()) {
-                if (not next_line()) 
+                if (not next_line()) {
+                    eof_hit = true;
                     throw parse_exc("END OF INPUT WHILE EXTRACTING");
+                }
                 result += '\n';
             }
             std::string s1(start, start + sym_begin.size() );
@@ -21,13 +21,24 @@
 #define __LEXER_HPP__
 
 #include <string>
+#include <string_view>
+#include <functional>
+#include <memory>
+#include <regex>
 #include <iostream>
 #include <vector>
+#include <deque>
 #include <stack>
 
 #define LEX_EMPTY  0
 #define LEX_ERROR -1
 
+// number of terminal attempts remembered by the lexer
+#define LEX_CACHE_SIZE 16
+
+// number of lines whose memory is kept by reset() for the next input
+#define LEX_SPARE_LINES 32
+
 namespace tipa {
     typedef int token_id;
 
@@ -47,22 +58,24 @@ namespace tipa {
     A token is a pair token-name, regular expression that identifies
     the token.  
 
-    @todo embed the regex into the class for optimizing execution
-    time.  Could also be done in a lazy way...
+    The regular expression is compiled once, when the token is
+    created, and shared by its copies.
 */
     struct token {
         token(const std::pair<token_id, std::string> &p) :
-            name(p.first), expr(p.second) {}
+            name(p.first), expr(p.second), re(std::make_shared<const std::regex>(expr)) {}
 
         token(const token_id &n, const std::string &e) :
-            name(n), expr(e) {}
+            name(n), expr(e), re(std::make_shared<const std::regex>(expr)) {}
 
         token_id    get_name() const { return name; } 
-        std::string get_expr() const { return expr; }
+        const std::string &get_expr() const { return expr; }
+        const std::regex &get_regex() const { return *re; }
         bool        is_instance(token_val v) const { return name == v.first; } 
     private:
         token_id name;
         std::string expr;
+        std::shared_ptr<const std::regex> re;
     };
 
     const int LEX_LIB_BASE    = 1000;
@@ -132,17 +145,64 @@ namespace tipa {
         // current position in the curr_line
         std::string::iterator start;
         std::istream *p_input;
+        // the input set by set_input() (when p_input is null), the
+        // position of the next line, and the end of the input reached
+        std::string_view view;
+        std::size_t view_pos;
+        bool view_eof;
         std::string curr_line;
         unsigned nline, ncol;
         
-        std::vector<std::string> all_lines;
-        std::stack<ctx> saved_ctx; 
+        // the lines read so far, except the first_line ones that
+        // have been released by commit()
+        std::deque<std::string> all_lines;
+        // the lines of the previous inputs, whose memory is reused
+        // (at most LEX_SPARE_LINES)
+        std::vector<std::string> spare_lines;
+        unsigned first_line;
+        std::vector<ctx> saved_ctx; 
+        // the saved contexts below this depth have been committed
+        std::size_t cut_depth;
+
+        // streaming mode: release the lines that cannot be reached
+        // by backtracking anymore
+        bool streaming;
+        // in streaming mode, maximum number of lines kept before the
+        // current one (0 = no limit)
+        std::size_t max_lookback;
 
         std::string comment_begin; 
         std::string comment_end;
         std::string comment_single_line;
 
+        // set when a token was requested but the input was exhausted
+        bool eof_hit;
+        // the last line is empty because the input ended after a new
+        // line (it may continue if the stream is extended)
+        bool open_line;
+
+        /* The results of the last terminal attempts (see
+           try_token()), keyed by the position and the token. The
+           lines are numbered from the beginning of the input, so an
+           entry never becomes wrong: when the cursor moves forward,
+           it is not found anymore and it is eventually replaced. */
+        struct cache_entry {
+            unsigned nl;
+            std::size_t off;
+            token_id id;
+            std::string expr;
+            long len;               // -1 if the token did not match
+        };
+        std::vector<cache_entry> cache;
+        std::size_t cache_next;
+        std::size_t cache_hits;
+
         bool next_line();
+        // reads a line from the input, like std::getline(): returns
+        // true if nothing could be read
+        bool read_line(std::string &s);
+        bool input_eof() const { return p_input ? p_input->eof() : view_eof; }
+        void release_lines();
         bool skip_spaces();
         void advance_start(int n=1);
         
@@ -152,10 +212,20 @@ namespace tipa {
     
         /// Saves the context of the lexer, we can restore it later
         void save(); 
-        /// Restores the context to the last saved one 
-        void restore();
+        /// Restores the context to the last saved one. Returns false
+        /// (and does not move) if that context has been committed.
+        /// Throws a parse_exc, without popping the context, if its
+        /// line has been released (see released_saved()).
+        bool restore();
+        /// true if the last saved context has not been committed, but
+        /// its line has been released in streaming mode
+        bool released_saved() const;
         /// Discard the last saved context
         void discard_saved();
+        /// Commits the current position: the contexts saved so far
+        /// cannot be restored anymore, and the lines before the
+        /// current one are released
+        void commit();
 
         /// Configures the lexer to skip all characters between strings b
         /// and e, and all characters from string sl until the end of the
@@ -166,18 +236,67 @@ namespace tipa {
 
         /// set the stream for this lexer
         void set_stream(std::istream &in);
+        /// Reads the input directly from the memory of s, which must
+        /// not change until the lexer is reset or given another input
+        void set_input(std::string_view s);
+        /// Forgets the input and the saved contexts, keeping the
+        /// memory allocated for them. set_stream() must be called
+        /// before reading again.
+        void reset();
+
+        /// Streaming mode: the lexer only keeps the lines that can
+        /// still be reached from the oldest saved context, so the
+        /// memory does not grow with the size of the input. If
+        /// max_lines is not 0, at most max_lines lines before the
+        /// current one are kept anyway, and a context that refers
+        /// to a released line cannot be restored.
+        void set_streaming(bool flag, std::size_t max_lines = 0);
 
         /// checks if the token is found, and returns it, or an error
         token_val try_token(const token &x);
 
+        /// as try_token(), but the matched text is not copied: it is
+        /// passed to fun (the view is only valid during the call), and
+        /// the second element of the returned token_val is empty
+        token_val try_token(const token &x, const std::function<void(std::string_view)> &fun);
+
+        /// Skips spaces and comments, and returns the rest of the
+        /// current line (empty at the end of the input). The view is
+        /// valid until the lexer is used again. Together with
+        /// consume(), it allows a rule to scan the input directly.
+        std::string_view peek_line();
+
+        /// moves n characters forward on the current line (see
+        /// peek_line()), then skips spaces
+        void consume(std::size_t n);
+
         /// returns the current position (line num, column num)
         std::pair<int, int> get_pos() const { return {nline, ncol}; }
 
         /// returns the line that is currently being processed
-        std::string get_currline() const { return curr_line; }
+        const std::string &get_currline() const { return curr_line; }
+
+        /// reads the next token, which is the first one of the list
+        /// that matches (or an error)
+        token_val next_token(const std::vector<token> &tokens);
 
         bool eof();
 
+        /// true if, since the last call to clear_eof_reached(), the
+        /// lexer has been asked for a token past the end of the input
+        bool eof_reached() const { return eof_hit; }
+        void clear_eof_reached() { eof_hit = false; }
+
+        /// number of contexts currently saved
+        std::size_t saved_depth() const { return saved_ctx.size(); }
+
+        /// number of input lines kept in memory for backtracking
+        std::size_t retained_lines() const { return all_lines.size(); }
+
+        /// number of terminal attempts that have been answered by
+        /// the cache, without running the regular expression
+        std::size_t cached_attempts() const { return cache_hits; }
+
         /**
            Extracts a string encompassed between the two strings
            sym_begin and sym_end. It takes into account nesting, so it
@@ -17,6 +17,9 @@
   You should have received a copy of the GNU General Public License
   along with TiPa. If not, see <http://www.gnu.org/licenses/>
  */
+/* Compile-time logging of the internals of the library. To follow
+   the rules invoked on an input at run time, use the tracer of the
+   parser context instead (see parser_context::set_trace()). */
 #ifdef __LOG__
 #include <iostream>
 #define INFO(x)        do {std::cout << x;} while(0)
@@ -0,0 +1,261 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+*/
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <exception>
+#include <algorithm>
+
+#include "records.hpp"
+#include "spsc_queue.hpp"
+
+namespace tipa {
+
+    namespace {
+        struct record_batch {
+            // the text of the records, when the input is a stream
+            std::string data;
+            std::vector<std::string_view> records;
+            // index of the first record
+            std::size_t first;
+            // the first nresults are the results of this batch (the
+            // others are kept for their memory)
+            std::vector<record_result> results;
+            std::size_t nresults;
+        };
+        typedef std::unique_ptr<record_batch> batch_ptr;
+        typedef spsc_queue<batch_ptr> batch_queue;
+
+        /* The threads of the pipeline wait for each other: a thread
+           that cannot go on (a queue is empty or full) retries a few
+           times, and then sleeps until another thread has changed a
+           queue or the stop flag. A queue operation is done for a
+           whole batch, so the lock is taken rarely. */
+        // the records of text; the last one may not be terminated
+        void split(std::string_view text, char delim, std::vector<std::string_view> &records)
+        {
+            std::size_t pos = 0;
+            while (pos < text.size()) {
+                auto d = text.find(delim, pos);
+                if (d == std::string_view::npos) d = text.size();
+                records.push_back(text.substr(pos, d - pos));
+                pos = d + 1;
+            }
+        }
+    }
+
+    record_parser::record_parser(const rule &r, unsigned n, char d) :
+        item(r), nworkers(n), delim(d), block(1 << 16)
+    {
+        if (nworkers == 0) nworkers = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    void record_parser::set_block_size(std::size_t bytes)
+    {
+        if (bytes == 0) throw parse_exc("record_parser::set_block_size(): the size cannot be 0");
+        block = bytes;
+    }
+
+    std::size_t record_parser::parse(std::istream &in, const record_fn &f)
+    {
+        return run(&in, std::string_view(), f);
+    }
+
+    std::size_t record_parser::parse(std::string_view buf, const record_fn &f)
+    {
+        return run(nullptr, buf, f);
+    }
+
+    /*
+      The reader gives batch k to worker k % n, and then an empty
+      batch to each worker; each worker passes its batches on, in
+      the same order, to its output queue. So the calling thread
+      finds the results in order by taking them from the output
+      queues in turn, until the first empty batch.
+
+      When something fails (or the callback throws), the stop flag is
+      set: the reader stops reading, the workers stop parsing (stop
+      is also the cancellation flag of their contexts), and the
+      calling thread drains all the queues, so that nobody waits
+      forever on a full one.
+    */
+    std::size_t record_parser::run(std::istream *in, std::string_view buf, const record_fn &f)
+    {
+        std::vector<std::unique_ptr<batch_queue>> to_worker, from_worker;
+        for (unsigned i = 0; i < nworkers; i++) {
+            to_worker.emplace_back(new batch_queue(TIPA_RECORD_QUEUE));
+            from_worker.emplace_back(new batch_queue(TIPA_RECORD_QUEUE));
+        }
+        // the batches already consumed, back to the reader
+        batch_queue free_batches(2 * TIPA_RECORD_QUEUE * nworkers + 2);
+        std::atomic<bool> stop(false);
+        queue_waiter sync;
+        std::exception_ptr reader_error;
+        std::vector<std::exception_ptr> worker_error(nworkers);
+
+        std::thread reader([&]() {
+                std::size_t index = 0, k = 0, pos = 0;
+                std::string carry;
+                bool more = true;
+                try {
+                    while (more && !stop.load(std::memory_order_relaxed)) {
+                        batch_ptr b;
+                        if (!free_batches.try_pop(b)) b.reset(new record_batch);
+                        b->records.clear();
+                        b->first = index;
+                        if (in) {
+                            // a block, up to the last delimiter
+                            b->data = carry;
+                            auto end = std::string::npos;
+                            while (end == std::string::npos && more) {
+                                auto old = b->data.size();
+                                b->data.resize(old + block);
+                                in->read(&b->data[old], block);
+                                b->data.resize(old + in->gcount());
+                                more = bool(*in);
+                                end = b->data.rfind(delim);
+                            }
+                            if (more) {
+                                carry.assign(b->data, end + 1, std::string::npos);
+                                b->data.resize(end + 1);
+                            }
+                            split(b->data, delim, b->records);
+                        }
+                        else {
+                            auto end = std::min(pos + block, buf.size());
+                            if (end < buf.size()) {
+                                auto d = buf.find(delim, end - 1);
+                                end = d == std::string_view::npos ? buf.size() : d + 1;
+                            }
+                            split(buf.substr(pos, end - pos), delim, b->records);
+                            pos = end;
+                            more = pos < buf.size();
+                        }
+                        if (b->records.empty()) continue;
+                        index += b->records.size();
+                        auto &q = *to_worker[k % nworkers];
+                        sync.wait([&]() { return q.try_push(std::move(b)) || stop.load(std::memory_order_relaxed); });
+                        k++;
+                    }
+                } catch (...) {
+                    reader_error = std::current_exception();
+                    stop = true;
+                    sync.notify();
+                }
+                for (unsigned i = 0; i < nworkers; i++) {
+                    auto &q = *to_worker[(k + i) % nworkers];
+                    sync.wait([&]() { return q.try_push(batch_ptr()); });
+                }
+            });
+
+        std::vector<std::thread> workers;
+        for (unsigned i = 0; i < nworkers; i++) 
+            workers.emplace_back([&, i]() {
+                    parser_context pc;
+                    if (setup) setup(pc);
+                    pc.set_cancel_flag(&stop);
+                    auto &in_q = *to_worker[i];
+                    auto &out_q = *from_worker[i];
+                    while (true) {
+                        batch_ptr b;
+                        sync.wait([&]() { return in_q.try_pop(b); });
+                        bool end = !b;
+                        if (b) b->nresults = 0;
+                        if (b && !stop.load(std::memory_order_relaxed)) {
+                            if (b->results.size() < b->records.size()) b->results.resize(b->records.size());
+                            try {
+                                for (std::size_t j = 0; j < b->records.size(); j++) {
+                                    auto &r = b->results[j];
+                                    r.index = b->first + j;
+                                    r.text = b->records[j];
+                                    pc.set_input(r.text);
+                                    try {
+                                        r.ok = parse_all(item, pc);
+                                        if (!r.ok) r.error = pc.get_last_error();
+                                        else r.error = parser_context::error_message();
+                                    } catch (parse_exc &e) {
+                                        r.ok = false;
+                                        r.error = { e.what(), pc.get_pos(), { LEX_ERROR, "" }, std::string(r.text) };
+                                    }
+                                    r.tokens = pc.collect_tokens();
+                                    r.values = pc.take_values();
+                                    b->nresults = j + 1;
+                                }
+                            } catch (...) {
+                                worker_error[i] = std::current_exception();
+                                stop = true;
+                                sync.notify();
+                            }
+                        }
+                        sync.wait([&]() { return out_q.try_push(std::move(b)); });
+                        if (end) break;
+                    }
+                });
+
+        std::size_t count = 0;
+        std::exception_ptr error;
+        std::vector<bool> done(nworkers, false);
+        for (std::size_t k = 0; !stop.load(std::memory_order_relaxed); k++) {
+            auto w = k % nworkers;
+            batch_ptr b;
+            sync.wait([&]() { return from_worker[w]->try_pop(b); });
+            if (!b) {
+                done[w] = true;
+                break;
+            }
+            // the batch may be incomplete
+            if (stop.load(std::memory_order_relaxed)) break;
+            try {
+                for (std::size_t j = 0; j < b->nresults; j++) {
+                    f(b->results[j]);
+                    count++;
+                }
+            } catch (...) {
+                error = std::current_exception();
+                stop = true;
+                sync.notify();
+            }
+            free_batches.try_push(std::move(b));
+        }
+        // waits for the empty batches of all the workers (each batch
+        // taken may let a worker go on)
+        while (std::find(done.begin(), done.end(), false) != done.end())
+            sync.wait([&]() {
+                    for (unsigned w = 0; w < nworkers; w++) {
+                        batch_ptr b;
+                        if (!done[w] && from_worker[w]->try_pop(b)) {
+                            if (!b) done[w] = true;
+                            return true;
+                        }
+                    }
+                    return false;
+                });
+
+        reader.join();
+        for (auto &t : workers) t.join();
+
+        if (error) std::rethrow_exception(error);
+        if (reader_error) std::rethrow_exception(reader_error);
+        for (auto &e : worker_error) if (e) std::rethrow_exception(e);
+        return count;
+    }
+}
@@ -0,0 +1,116 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef __RECORDS_HPP__
+#define __RECORDS_HPP__
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <istream>
+
+#include <tinyparser.hpp>
+
+/// number of batches that can wait in each queue of a record_parser
+#define TIPA_RECORD_QUEUE 8
+
+namespace tipa {
+
+    /// the result of parsing one record (see record_parser)
+    struct record_result {
+        /// number of the record in the input, from 0
+        std::size_t index;
+        /// the text of the record, without the delimiter (valid only
+        /// during the callback)
+        std::string_view text;
+        /// true if the rule matched all the record
+        bool ok;
+        /// the tokens collected and the values pushed by the rule
+        /// (see parser_context::collect_tokens() and
+        /// parser_context::take_values())
+        std::vector<token_val> tokens;
+        std::vector<sem_value> values;
+        /// if the record did not match, the last error
+        parser_context::error_message error;
+    };
+
+    typedef std::function<void(record_result &)> record_fn;
+
+    /**
+       Parses an input made of independent records, one per line (or
+       terminated by another delimiter), as with parse_all(item, pc)
+       on each record.
+
+       The records are parsed by a pipeline: a reader thread splits
+       the input into batches of records (each batch is one block of
+       the input, shared by its records), a number of worker threads
+       parse the batches, each with its own parser_context, and the
+       calling thread invokes the callback on each result, in the
+       order of the input:
+
+       \code
+       record_parser p(line);
+       p.parse(file, [](record_result &r) {
+               if (!r.ok) std::cerr << r.index + 1 << ": " << r.error.msg << std::endl;
+           });
+       \endcode
+
+       The threads exchange the batches with lock-free queues (see
+       spsc_queue): the reader gives batch k to worker k % n, and the
+       results are taken back in the same order. The batches are then
+       recycled, so their memory is reused.
+
+       The actions of the rule are invoked by the workers, in
+       parallel: they should not modify shared data, but push values
+       (see parser_context::push_value()), which are passed to the
+       callback. If the callback throws an exception, the parsing
+       stops and the exception is thrown by parse().
+     */
+    class record_parser {
+        rule item;
+        unsigned nworkers;
+        char delim;
+        std::size_t block;
+        std::function<void(parser_context &)> setup;
+    public:
+        /// nworkers = 0 uses one worker for each hardware thread
+        record_parser(const rule &r, unsigned nworkers = 0, char delim = '\n');
+
+        /// size of the blocks in which the input is read (64 KiB by
+        /// default), which is also the size of a batch
+        void set_block_size(std::size_t bytes);
+
+        /// f is invoked on the context of each worker, before
+        /// parsing (for example to set the comments)
+        void set_context_setup(std::function<void(parser_context &)> f) { setup = std::move(f); }
+
+        /// number of worker threads
+        unsigned workers() const { return nworkers; }
+
+        /// parses all the records of the stream, returns their number
+        std::size_t parse(std::istream &in, const record_fn &f);
+        /// parses all the records of buf, which is not copied
+        std::size_t parse(std::string_view buf, const record_fn &f);
+    private:
+        std::size_t run(std::istream *in, std::string_view buf, const record_fn &f);
+    };
+}
+
+#endif
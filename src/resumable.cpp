@@ -0,0 +1,136 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+*/
+#include "resumable.hpp"
+
+namespace tipa {
+
+    resumable_parser::resumable_parser(const rule &r) :
+        item(r), closed(false), failed(false), starved(false)
+    {
+        // the items already parsed are never needed again
+        pc.set_streaming(true);
+        pc.set_stream(buffer);
+    }
+
+    /*
+      The lexer reads the buffer line by line, so only complete lines
+      are appended to it (except when closing). When everything in
+      the buffer has been read, the buffer is replaced rather than
+      extended, so it does not keep the whole input.
+    */
+    void resumable_parser::append(const std::string &s)
+    {
+        starved = false;
+        if (buffer.rdbuf()->in_avail() == 0) {
+            buffer.str(s);
+            buffer.clear();
+            buffer.seekp(0, std::ios::end);
+        }
+        else {
+            buffer.clear();
+            buffer << s;
+        }
+    }
+
+    void resumable_parser::feed(const std::string &chunk)
+    {
+        if (closed) throw parse_exc("resumable_parser::feed(): the input has been closed");
+
+        pending += chunk;
+        auto pos = pending.rfind('\n');
+        if (pos == std::string::npos) return;
+        append(pending.substr(0, pos + 1));
+        pending.erase(0, pos + 1);
+    }
+
+    void resumable_parser::close()
+    {
+        closed = true;
+        starved = false;
+        if (!pending.empty()) {
+            append(pending);
+            pending.clear();
+        }
+    }
+
+    // restores the context saved at the given depth, dropping all
+    // the contexts saved after it
+    void resumable_parser::unwind(std::size_t depth)
+    {
+        while (pc.saved_depth() > depth + 1) pc.discard_saved();
+        pc.restore();
+    }
+
+    /*
+      Matches the next item without actions, and then goes back.
+      Returns true if the match depends on input that has not been
+      received yet.
+    */
+    bool resumable_parser::try_item(bool &at_end)
+    {
+        std::size_t depth = pc.saved_depth();
+        pc.clear_eof_reached();
+        pc.enable_actions(false);
+        pc.save();
+        try {
+            at_end = pc.eof();
+            if (!at_end) item.parse(pc);
+        } catch (parse_exc &e) {
+            pc.enable_actions(true);
+            unwind(depth);
+            if (!pc.eof_reached()) throw;
+            return true;
+        }
+        pc.enable_actions(true);
+        unwind(depth);
+        return at_end || pc.eof_reached();
+    }
+
+    step_status resumable_parser::step()
+    {
+        if (failed) return STEP_ERROR;
+
+        // the same input would give the same answer
+        if (starved) return STEP_NEED_INPUT;
+
+        bool at_end = false;
+        if (!closed && try_item(at_end)) {
+            pc.empty_error_stack();
+            starved = true;
+            return STEP_NEED_INPUT;
+        }
+
+        if (pc.eof()) return STEP_DONE;
+
+        auto pos = pc.get_pos();
+        if (!item.parse(pc)) {
+            failed = true;
+            return STEP_ERROR;
+        }
+        if (pc.get_pos() == pos) {
+            // the item matched the empty string: it would match forever
+            pc.set_error({ERR_PARSE_SEQ, "Item did not consume input"}, "Resumable parser failed");
+            failed = true;
+            return STEP_ERROR;
+        }
+        pc.empty_error_stack();
+        return STEP_ITEM;
+    }
+}
@@ -0,0 +1,105 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef __RESUMABLE_HPP__
+#define __RESUMABLE_HPP__
+
+#include <string>
+#include <sstream>
+
+#include <tinyparser.hpp>
+
+namespace tipa {
+
+    typedef enum {
+        STEP_ITEM,        // one more item has been parsed
+        STEP_NEED_INPUT,  // the parser is waiting for more input
+        STEP_DONE,        // all the input has been parsed
+        STEP_ERROR        // the input does not match the rule
+    } step_status;
+
+    /**
+       A parser that can be suspended while waiting for input.
+
+       The input is a sequence of items, each one matched by the same
+       rule (as in parse_all(*item, pc)). The input is passed in
+       chunks with feed(), and close() signals that no more input will
+       come. Each call to step() parses at most one item, and never
+       blocks: when the available input is not sufficient to decide
+       on the next item, step() returns STEP_NEED_INPUT and the parser
+       can be resumed after the next call to feed().
+
+       Therefore, many parsers can be multiplexed on a single thread,
+       for example in an event loop (or awaited from a coroutine):
+
+       \code
+       resumable_parser p(item);
+       while (true) {
+           auto s = p.step();
+           if (s == STEP_NEED_INPUT) {
+               if (read_some(buf)) p.feed(buf);
+               else p.close();
+           }
+           else if (s != STEP_ITEM) break;
+       }
+       \endcode
+
+       Until the input is closed, an item is first matched with the
+       actions disabled, and then matched again (with the actions)
+       once it is known that it does not depend on input which has
+       not been received yet. So, each action is invoked exactly
+       once. After STEP_NEED_INPUT, the item is not matched again
+       until a new line (or the end of the input) has been received,
+       so feeding a line in many small chunks does not parse it
+       again for each chunk. The lexer is in streaming mode, so the
+       lines of the items already parsed are released.
+     */
+    class resumable_parser {
+        rule item;
+        parser_context pc;
+        std::stringstream buffer;
+        // last line received, not yet terminated by a new line
+        std::string pending;
+        bool closed;
+        bool failed;
+        // the last step needed more input, and the lexer has not
+        // received anything since
+        bool starved;
+
+        void append(const std::string &s);
+        void unwind(std::size_t depth);
+        bool try_item(bool &starved);
+    public:
+        resumable_parser(const rule &r);
+
+        /// appends a chunk of input
+        void feed(const std::string &chunk);
+
+        /// signals that no more input will be received
+        void close();
+
+        /// parses the next item, if possible
+        step_status step();
+
+        /// the parser context (to set comments, read errors, etc.)
+        parser_context &context() { return pc; }
+    };
+}
+
+#endif
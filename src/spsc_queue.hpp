@@ -0,0 +1,131 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef __SPSC_QUEUE_HPP__
+#define __SPSC_QUEUE_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+
+namespace tipa {
+
+    /**
+       A bounded lock-free queue between one producer thread and one
+       consumer thread.
+
+       The elements are in a ring buffer whose size is a power of
+       2. The producer only writes tail, the consumer only writes
+       head, and each one keeps a copy of the other index, so that
+       it reads the shared one only when the queue looks full (or
+       empty). The two indexes are on different cache lines.
+     */
+    template <class T>
+    class spsc_queue {
+        static constexpr std::size_t line = 64;
+
+        std::size_t mask;
+        std::unique_ptr<T[]> ring;
+
+        alignas(line) std::atomic<std::size_t> head;
+        std::size_t cached_tail;
+        alignas(line) std::atomic<std::size_t> tail;
+        std::size_t cached_head;
+    public:
+        /// a queue of at least capacity elements
+        explicit spsc_queue(std::size_t capacity) : head(0), cached_tail(0), tail(0), cached_head(0) {
+            std::size_t n = 2;
+            while (n < capacity) n *= 2;
+            mask = n - 1;
+            ring.reset(new T[n]);
+        }
+        spsc_queue(const spsc_queue &) = delete;
+        spsc_queue &operator=(const spsc_queue &) = delete;
+
+        /// (producer) appends x, unless the queue is full
+        bool try_push(T &&x) {
+            auto t = tail.load(std::memory_order_relaxed);
+            if (t - cached_head > mask) {
+                cached_head = head.load(std::memory_order_acquire);
+                if (t - cached_head > mask) return false;
+            }
+            ring[t & mask] = std::move(x);
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// (consumer) removes the first element into x, unless the
+        /// queue is empty
+        bool try_pop(T &x) {
+            auto h = head.load(std::memory_order_relaxed);
+            if (h == cached_tail) {
+                cached_tail = tail.load(std::memory_order_acquire);
+                if (h == cached_tail) return false;
+            }
+            x = std::move(ring[h & mask]);
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// number of elements it can contain
+        std::size_t capacity() const { return mask + 1; }
+    };
+
+    /**
+       Lets the threads that use some spsc_queue wait for each
+       other: a thread whose queue is full (or empty) spins for a
+       while, and then sleeps until another thread changes a queue.
+     */
+    class queue_waiter {
+        std::mutex m;
+        std::condition_variable cv;
+        std::size_t changes = 0;
+    public:
+        /// wakes up the threads waiting
+        void notify() {
+            {
+                std::lock_guard<std::mutex> lk(m);
+                changes++;
+            }
+            cv.notify_all();
+        }
+        /// retries f until it succeeds, and then notifies the others
+        template<class F>
+        void wait(F f) {
+            bool ok = false;
+            for (int i = 0; i < 64 && !(ok = f()); i++) std::this_thread::yield();
+            if (!ok) {
+                std::unique_lock<std::mutex> lk(m);
+                // a change can only happen when the lock is released
+                while (!f()) {
+                    auto c = changes;
+                    cv.wait(lk, [this, c]() { return changes != c; });
+                }
+            }
+            notify();
+        }
+    };
+}
+
+#endif
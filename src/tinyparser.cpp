@@ -21,11 +21,24 @@
 //#define __LOG__ 1
 #include "log_macros.hpp"
 #include "tinyparser.hpp"
+#include "spsc_queue.hpp"
 #include "wptr.hpp"
 
 #include <sstream>
+#include <iomanip>
 #include <set>
+#include <map>
+#include <cctype>
+#include <cstring>
+#include <cstdint>
+#include <limits>
 #include <algorithm>
+#include <iterator>
+#include <regex>
+#include <mutex>
+#include <unordered_map>
+#include <thread>
+#include <condition_variable>
 
 #ifdef __LOG__
 int abs_counter=0;
@@ -44,16 +57,90 @@ namespace tipa {
        parser.  In fact, the state is not stored in the rules, but in
        this context that is passed around the rules and updated accordingly.
     */
-    parser_context::parser_context() : lex{}
+    parser_context::parser_context() : lex{}, cut_depth(0), nerrors(0), actions_on(true), halted(false),
+                                       engine(ENGINE_RECURSIVE), depth(0), max_depth(0),
+                                       steps(0), step_limit(0), time_limit(0), 
+                                       deadline(std::chrono::steady_clock::time_point::max()),
+                                       cancel_flag(nullptr), next_check(SIZE_MAX),
+                                       pretok(false), tok_id_base(0), tok_index(0), tok_eof_hit(false),
+                                       trace_on(false), trace_count(0), trace_dump(nullptr)
     {}
+
+    parser_context::~parser_context()
+    {
+        stop_pipe();
+        stop_actions();
+    }
     
     void parser_context::set_stream(std::istream &in)
     {
+        reset();
         lex.set_stream(in);
+    }
+
+    void parser_context::set_input(std::string_view s)
+    {
+        reset();
+        lex.set_input(s);
+    }
+
+    void parser_context::reset()
+    {
+        stop_pipe();
+        // the actions of the previous input (call wait_actions()
+        // before, to get their exceptions)
+        if (async) {
+            try { wait_actions(); } catch (...) {}
+        }
+        lex.reset();
         collected.clear();
-        //saved.clear();
-        while (!saved.empty()) saved.pop();
-        //while (!ncoll.empty()) ncoll.pop();
+        values.clear();
+        saved.clear();
+        cut_depth = 0;
+        halted = false;
+        depth = 0;
+        empty_error_stack();
+        reset_budget();
+        pretok = false;
+        tok_recs.clear();
+        tok_ids.clear();
+        tok_split.clear();
+        src_lines.clear();
+        src.clear();
+        tok_index = 0;
+        tok_eof_hit = false;
+        tok_error = nullptr;
+        trace_count = 0;
+    }
+
+    context_pool::handle context_pool::acquire()
+    {
+        if (free_list.empty()) return handle(new parser_context, releaser{this});
+        auto p = free_list.back().release();
+        free_list.pop_back();
+        return handle(p, releaser{this});
+    }
+
+    void context_pool::releaser::operator()(parser_context *pc) const
+    {
+        pc->reset();
+        // the settings of a single request (see the class comment)
+        pc->set_deadline(std::chrono::steady_clock::time_point::max());
+        pc->set_cancel_flag(nullptr);
+        pc->set_trace(0);
+        if (pool->free_list.size() < pool->max_free) pool->free_list.emplace_back(pc);
+        else delete pc;
+    }
+
+    context_pool &context_pool::local()
+    {
+        static thread_local context_pool pool;
+        return pool;
+    }
+
+    void parser_context::set_streaming(bool flag, std::size_t max_lines)
+    {
+        lex.set_streaming(flag, max_lines);
     }
 
     void parser_context::set_comment(const std::string &comment_begin, 
@@ -66,19 +153,428 @@ namespace tipa {
 
     token_val parser_context::try_token(const token &tk)
     {
-        return lex.try_token(tk);
+        if (!pretok) return lex.try_token(tk);
+        std::string res;
+        token_val tv = match_record(tk, [&res](std::string_view v) { res = v; });
+        if (tv.first == tk.get_name()) tv.second = std::move(res);
+        return tv;
+    }
+
+    token_val parser_context::try_token(const token &tk, const std::function<void(std::string_view)> &fun)
+    {
+        if (!pretok) return lex.try_token(tk, fun);
+        return match_record(tk, fun);
     }
 
     std::string parser_context::extract(const std::string &op, const std::string &cl)
     {
+        no_pretok("extract");
         return lex.extract(op, cl);
     }
 
     std::string parser_context::extract_line()
     {
+        no_pretok("extract_line");
         return lex.extract_line();
     }
 
+    void parser_context::no_pretok(const char *fn) const
+    {
+        if (pretok) 
+            throw parse_exc(std::string("parser_context::") + fn + "() cannot be used in pretokenized mode");
+    }
+
+    /*
+      If expr is the expression of a literal (see padding()), copies
+      the unescaped text into lit.
+    */
+    static bool plain_literal(const std::string &expr, std::string &lit)
+    {
+        static std::string elements{".[{}()\\*+?|^$"};
+        for (std::size_t i = 0; i < expr.size(); i++) {
+            if (expr[i] == '\\') {
+                if (++i == expr.size() || elements.find(expr[i]) == std::string::npos) return false;
+            }
+            else if (elements.find(expr[i]) != std::string::npos) return false;
+            lit.append(1, expr[i]);
+        }
+        return lit.size() > 0;
+    }
+
+    /*
+      Splits the next line of the input that contains a token. The
+      lexer moves to the following line only when looking for the
+      next token, so a line is complete when the position changes
+      line.
+    */
+    bool parser_context::lex_line(const std::vector<token> &tokens, token_line &l)
+    {
+        std::string_view v = lex.peek_line();
+        if (v.empty()) return false;
+        l.nline = lex.get_pos().first;
+        l.text = lex.get_currline();
+        l.recs.clear();
+        while (!v.empty() && lex.get_pos().first == l.nline) {
+            auto pos = lex.get_pos();
+            std::size_t off = l.text.size() - v.size();
+            token_val tv = lex.next_token(tokens);
+            token_rec r = {tv.first, std::uint32_t(off), std::uint32_t(tv.second.size()),
+                           0, std::uint32_t(pos.second)};
+            if (tv.first == LEX_ERROR) {
+                r.id = tk_char.get_name();
+                r.len = 1;
+                lex.consume(1);
+            }
+            else if (tv.second.empty()) {
+                // the position would not advance anymore
+                auto p = std::find_if(tokens.begin(), tokens.end(),
+                                      [&tv](const token &t) { return t.get_name() == tv.first; });
+                throw parse_exc("parser_context::pretokenize(): the token " + 
+                                (p != tokens.end() ? p->get_expr() : std::to_string(tv.first)) +
+                                " matches an empty string at line " + std::to_string(pos.first) +
+                                ", column " + std::to_string(pos.second));
+            }
+            l.recs.push_back(r);
+            // the lines already read are not needed anymore
+            lex.commit();
+            v = lex.peek_line();
+        }
+        return true;
+    }
+
+    void parser_context::append_line(const token_line &l)
+    {
+        // the records keep 32 bits offsets in src
+        if (src.size() + l.text.size() >= UINT32_MAX)
+            throw parse_exc("parser_context::pretokenize(): more than 4 GiB of text before line " +
+                            std::to_string(l.nline) + " (use cut() to drop the tokens already parsed)");
+        std::uint32_t line = src_lines.size();
+        src_lines.push_back({src.size(), l.text.size(), l.nline});
+        for (auto r : l.recs) {
+            r.offset += src.size();
+            r.line = line;
+            tok_recs.push_back(r);
+        }
+        // the text of a line is copied once
+        src += l.text;
+        src += '\n';
+    }
+
+    struct parser_context::token_pipe {
+        spsc_queue<token_line> queue;
+        std::atomic<bool> stop;
+        // set by the lexer thread after the last line, with the final
+        // position (or the exception thrown by the lexer)
+        std::atomic<bool> done;
+        std::pair<int, int> end;
+        std::exception_ptr error;
+        queue_waiter sync;
+        std::thread th;
+
+        token_pipe() : queue(TIPA_PIPE_LINES), stop(false), done(false) {}
+    };
+
+    void parser_context::pretokenize(const std::vector<token> &tokens, bool pipelined)
+    {
+        if (pretok) throw parse_exc("parser_context::pretokenize(): the input has already been tokenized");
+        if (saved.size() > 0) throw parse_exc("parser_context::pretokenize(): the parsing has already started");
+
+        tok_ids.clear();
+        for (auto &x : tokens) tok_ids.push_back(x.get_name());
+        std::sort(tok_ids.begin(), tok_ids.end());
+        tok_split.clear();
+        if (!tok_ids.empty() && std::int64_t(tok_ids.back()) - tok_ids.front() < 65536) {
+            tok_id_base = tok_ids.front();
+            tok_split.assign(tok_ids.back() - tok_id_base + 1, false);
+            for (auto id : tok_ids) tok_split[id - tok_id_base] = true;
+        }
+        tok_index = 0;
+        tok_eof_hit = false;
+        tok_error = nullptr;
+        pretok = true;
+
+        if (!pipelined) {
+            token_line l;
+            while (lex_line(tokens, l)) append_line(l);
+            tok_end = lex.get_pos();
+            return;
+        }
+
+        // from now on, only the lexer thread uses lex
+        pipe.reset(new token_pipe);
+        auto p = pipe.get();
+        p->th = std::thread([this, p, tokens]() {
+                try {
+                    token_line l;
+                    while (!p->stop.load(std::memory_order_relaxed) && lex_line(tokens, l)) 
+                        p->sync.wait([&]() { 
+                                return p->queue.try_push(std::move(l)) || p->stop.load(std::memory_order_relaxed); 
+                            });
+                    p->end = lex.get_pos();
+                } catch (...) {
+                    p->error = std::current_exception();
+                }
+                p->done.store(true, std::memory_order_release);
+                p->sync.notify();
+            });
+        fetch_tokens(0);
+    }
+
+    bool parser_context::fetch_tokens(std::size_t i)
+    {
+        token_line l;
+        while (pipe && i >= tok_recs.size()) {
+            bool got = false;
+            pipe->sync.wait([&]() { 
+                    return (got = pipe->queue.try_pop(l)) || pipe->done.load(std::memory_order_acquire); 
+                });
+            if (got) {
+                append_line(l);
+                continue;
+            }
+            // the last lines were pushed before done was set
+            while (pipe->queue.try_pop(l)) append_line(l);
+            pipe->th.join();
+            tok_end = pipe->end;
+            tok_error = pipe->error;
+            pipe.reset();
+        }
+        return i < tok_recs.size();
+    }
+
+    bool parser_context::tok_ready(std::size_t i)
+    {
+        if (i < tok_recs.size() || fetch_tokens(i)) return true;
+        if (tok_error) std::rethrow_exception(tok_error);
+        return false;
+    }
+
+    void parser_context::drop_tokens()
+    {
+        // each record is moved at most once for each one dropped
+        std::size_t n = tok_index;
+        if (n < TIPA_PRETOK_TRIM || n < tok_recs.size() - n) return;
+        // the line of the current record, or the last one (for the
+        // error messages at the end)
+        std::size_t nl = n < tok_recs.size() ? tok_recs[n].line : src_lines.size() - 1;
+        std::size_t off = src_lines[nl].offset;
+        src.erase(0, off);
+        src_lines.erase(src_lines.begin(), src_lines.begin() + nl);
+        for (auto &sl : src_lines) sl.offset -= off;
+        tok_recs.erase(tok_recs.begin(), tok_recs.begin() + n);
+        for (auto &r : tok_recs) {
+            r.offset -= off;
+            r.line -= nl;
+        }
+        tok_index = 0;
+        // the contexts saved before the commit are never restored
+        for (auto &cp : saved) cp.index = cp.index > n ? cp.index - n : 0;
+    }
+
+    void parser_context::stop_pipe()
+    {
+        if (!pipe) return;
+        pipe->stop = true;
+        pipe->sync.notify();
+        pipe->th.join();
+        pipe.reset();
+    }
+
+    /* The events go to the consumer thread in batches, so that the
+       queue is touched once every TIPA_ACTION_BATCH actions. The
+       batches come back to the parser through another queue, and
+       are reused with the memory of their tokens. */
+    struct parser_context::action_queue {
+        struct event {
+            const async_action_fn *fn;
+            std::vector<token_val> tokens;
+        };
+        struct batch {
+            std::vector<event> ev;
+            std::size_t n = 0;
+        };
+        spsc_queue<batch *> full;
+        spsc_queue<batch *> empty;
+        // the batch being filled by the parser
+        batch *cur;
+        // batches sent by the parser (written under m), and
+        // completed by the consumer
+        std::size_t sent;
+        std::atomic<std::size_t> completed;
+        // the first exception thrown by an action (read by the parser
+        // after completed has reached sent)
+        std::exception_ptr error;
+        std::atomic<bool> stop;
+        // an idle consumer sleeps on cv, until a batch is sent or
+        // stop is set
+        std::mutex m;
+        std::condition_variable cv;
+        std::thread th;
+
+        action_queue() : full(TIPA_ACTION_QUEUE), empty(TIPA_ACTION_QUEUE), cur(new batch), 
+                         sent(0), completed(0), stop(false) {}
+        ~action_queue() {
+            delete cur;
+            batch *b;
+            while (full.try_pop(b)) delete b;
+            while (empty.try_pop(b)) delete b;
+        }
+
+        void run() {
+            // number of batches taken, and of attempts before sleeping
+            std::size_t taken = 0;
+            const int spins = 100;
+            int idle = 0;
+            batch *b;
+            while (true) {
+                if (!full.try_pop(b)) {
+                    if (stop.load(std::memory_order_acquire) && !full.try_pop(b)) return;
+                    if (++idle < spins) std::this_thread::yield();
+                    else {
+                        std::unique_lock<std::mutex> lk(m);
+                        cv.wait(lk, [this, taken]() { return sent != taken || stop.load(); });
+                    }
+                    continue;
+                }
+                idle = 0;
+                taken++;
+                for (std::size_t i = 0; i < b->n && !error; i++) {
+                    auto &e = b->ev[i];
+                    try {
+                        (*e.fn)(token_span(e.tokens.data(), e.tokens.data() + e.tokens.size()));
+                    } catch (...) {
+                        error = std::current_exception();
+                    }
+                }
+                b->n = 0;
+                if (!empty.try_push(std::move(b))) delete b;
+                completed.fetch_add(1, std::memory_order_release);
+            }
+        }
+    };
+
+    void parser_context::set_async_actions(bool flag)
+    {
+        if (flag == bool(async)) return;
+        if (!flag) {
+            wait_actions();
+            stop_actions();
+            return;
+        }
+        async.reset(new action_queue);
+        auto q = async.get();
+        q->th = std::thread([q]() { q->run(); });
+    }
+
+    void parser_context::post_action(const async_action_fn &f, token_span s)
+    {
+        if (!async) {
+            f(s);
+            return;
+        }
+        auto b = async->cur;
+        if (b->n == b->ev.size()) b->ev.emplace_back();
+        auto &e = b->ev[b->n++];
+        e.fn = &f;
+        e.tokens.assign(s.begin(), s.end());
+        if (b->n == TIPA_ACTION_BATCH) flush_actions();
+    }
+
+    void parser_context::flush_actions()
+    {
+        auto q = async.get();
+        if (q->cur->n == 0) return;
+        while (!q->full.try_push(std::move(q->cur))) std::this_thread::yield();
+        {
+            std::lock_guard<std::mutex> lk(q->m);
+            q->sent++;
+        }
+        q->cv.notify_one();
+        if (!q->empty.try_pop(q->cur)) q->cur = new action_queue::batch;
+    }
+
+    void parser_context::wait_actions()
+    {
+        if (!async) return;
+        flush_actions();
+        while (async->completed.load(std::memory_order_acquire) != async->sent)
+            std::this_thread::yield();
+        if (async->error) {
+            auto e = async->error;
+            async->error = nullptr;
+            std::rethrow_exception(e);
+        }
+    }
+
+    void parser_context::stop_actions()
+    {
+        if (!async) return;
+        // the consumer runs the pending actions before stopping
+        flush_actions();
+        {
+            std::lock_guard<std::mutex> lk(async->m);
+            async->stop.store(true, std::memory_order_release);
+        }
+        async->cv.notify_one();
+        async->th.join();
+        async.reset();
+    }
+
+    bool parser_context::splits_input(token_id id) const
+    {
+        if (tok_split.empty()) return std::binary_search(tok_ids.begin(), tok_ids.end(), id);
+        std::int64_t i = std::int64_t(id) - tok_id_base;
+        return i >= 0 && i < std::int64_t(tok_split.size()) && tok_split[i];
+    }
+
+    token_val parser_context::match_record(const token &tk, const std::function<void(std::string_view)> &fun)
+    {
+        static thread_local std::match_results<std::string::const_iterator> what;
+
+        if (!tok_ready(tok_index)) {
+            tok_eof_hit = true;
+            return { LEX_ERROR, "EOF" };
+        }
+
+        const token_rec &r = tok_recs[tok_index];
+        std::size_t next = tok_index + 1;
+        if (splits_input(tk.get_name())) {
+            if (r.id != tk.get_name()) return { LEX_ERROR, "Token does not match" };
+            fun(std::string_view(src.data() + r.offset, r.len));
+        }
+        else {
+            // the token has not been used for splitting the input:
+            // its expression must match exactly one or more tokens
+            // of the same line
+            const source_line &sl = src_lines[r.line];
+            std::size_t len = 0;
+            std::string lit;
+            if (plain_literal(tk.get_expr(), lit)) {
+                if (src.compare(r.offset, lit.size(), lit) != 0 || 
+                    r.offset + lit.size() > sl.offset + sl.len)
+                    return { LEX_ERROR, "Token does not match" };
+                len = lit.size();
+            }
+            else {
+                if (std::regex_search(src.cbegin() + r.offset, src.cbegin() + sl.offset + sl.len, what, tk.get_regex(),
+                                      std::regex_constants::match_continuous))
+                    len = what.length(0);
+            }
+            std::size_t end = r.offset + len;
+            std::size_t k = tok_index;
+            while (k < tok_recs.size() && tok_recs[k].line == r.line &&
+                   tok_recs[k].offset + tok_recs[k].len < end) k++;
+            if (len == 0 || k == tok_recs.size() || tok_recs[k].line != r.line ||
+                tok_recs[k].offset + tok_recs[k].len != end)
+                return { LEX_ERROR, "Token does not match" };
+            next = k + 1;
+            fun(std::string_view(src.data() + r.offset, len));
+        }
+        tok_index = next;
+        fetch_tokens(tok_index);
+        return token_val(tk.get_name(), "");
+    }
+
     void parser_context::push_token(token_val tk)
     {
         collected.push_back(tk);
@@ -91,24 +587,198 @@ namespace tipa {
 
     void parser_context::save() 
     {
-        lex.save();
-        saved.push(collected);
+        if (!pretok) lex.save();
+        saved.push_back({collected.size(), {}, values.size(), {}, tok_index});
     }
 
     void parser_context::restore()
     {
-        lex.restore();
+        if (!pretok && lex.released_saved()) {
+            // the lexer cannot go back: the parser stops as after a cut
+            discard_saved();
+            if (!halted) set_error({ERR_PARSE_LOOKBACK, "Cannot go back to a released line"}, 
+                                   "Rule failed after the lookback of the streaming mode");
+            halted = true;
+            return;
+        }
+        bool f = pretok ? saved.size() > cut_depth : lex.restore();
         if (saved.size() < 1) throw parse_exc("parser_context::restore() on an empty stack !!!") ;
-        collected = saved.top();
-        saved.pop();
+        if (f) {
+            auto &cp = saved.back();
+            tok_index = cp.index;
+            collected.resize(cp.valid);
+            std::move(cp.tail.rbegin(), cp.tail.rend(), std::back_inserter(collected));
+            values.resize(cp.vvalid);
+            std::move(cp.vtail.rbegin(), cp.vtail.rend(), std::back_inserter(values));
+        }
+        saved.pop_back();
+        if (saved.size() < cut_depth) {
+            // trying to backtrack before a cut
+            cut_depth = saved.size();
+            if (!halted) set_error({ERR_PARSE_CUT, "Cannot backtrack after a cut"}, "Rule failed after a cut");
+            halted = true;
+        }
     }
  
     void parser_context::discard_saved()
     {
-        lex.discard_saved();
+        if (!pretok) lex.discard_saved();
         //ncoll.pop();
         if (saved.size() < 1) throw parse_exc("parser_context::discard_saved() on an empty stack !!!") ;
-        saved.pop();
+        saved.pop_back();
+        if (saved.size() < cut_depth) cut_depth = saved.size();
+    }
+
+    void parser_context::commit()
+    {
+        if (!pretok) lex.commit();
+        else drop_tokens();
+        // the committed contexts will never be restored
+        for (auto i = cut_depth; i < saved.size(); ++i) {
+            std::vector<token_val>().swap(saved[i].tail);
+            std::vector<sem_value>().swap(saved[i].vtail);
+        }
+        cut_depth = saved.size();
+        empty_error_stack();
+    }
+
+    void parser_context::set_budget(std::size_t max_steps, std::chrono::milliseconds max_time)
+    {
+        step_limit = max_steps;
+        time_limit = max_time;
+        reset_budget();
+    }
+
+    void parser_context::set_deadline(std::chrono::steady_clock::time_point t)
+    {
+        deadline = t;
+        next_check = 0;
+    }
+
+    void parser_context::set_cancel_flag(const std::atomic<bool> *flag)
+    {
+        cancel_flag = flag;
+        next_check = 0;
+    }
+
+    void parser_context::reset_budget()
+    {
+        steps = 0;
+        started = std::chrono::steady_clock::now();
+        next_check = 0;
+        check_budget();
+    }
+
+    void parser_context::set_trace(std::size_t nevents, std::ostream *on_failure)
+    {
+        trace_on = nevents > 0;
+        trace_buf.resize(nevents);
+        trace_buf.shrink_to_fit();
+        trace_count = 0;
+        trace_dump = on_failure;
+    }
+
+    void parser_context::record_trace(const impl_rule *r, trace_kind k)
+    {
+        auto &e = trace_buf[trace_count++ % trace_buf.size()];
+        e.rule = r;
+        auto pos = get_pos();
+        e.line = pos.first;
+        e.col = pos.second;
+        e.kind = k;
+        e.depth = depth;
+        e.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - started).count();
+    }
+
+    std::vector<trace_event> parser_context::get_trace() const
+    {
+        std::vector<trace_event> v;
+        if (trace_buf.empty()) return v;
+        std::size_t n = std::min(trace_count, trace_buf.size());
+        for (std::size_t i = trace_count - n; i < trace_count; i++) 
+            v.push_back(trace_buf[i % trace_buf.size()]);
+        return v;
+    }
+
+    bool parser_context::check_budget()
+    {
+        if (cancel_flag && cancel_flag->load(std::memory_order_relaxed)) {
+            next_check = 0;
+            if (!halted) set_error({ERR_PARSE_CANCELLED, "Parsing cancelled"}, 
+                                   "Cancelled after " + std::to_string(steps) + " steps");
+            halted = true;
+            return false;
+        }
+        bool timed = time_limit.count() != 0 || deadline != std::chrono::steady_clock::time_point::max();
+        auto now = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+        bool over_steps = step_limit != 0 && steps > step_limit;
+        bool over_time = timed && (now > deadline || (time_limit.count() != 0 && now - started > time_limit));
+        if (over_steps || over_time) {
+            // all the following rules fail
+            next_check = 0;
+            if (!halted) 
+                set_error({ERR_PARSE_BUDGET, "Parsing budget exceeded"}, 
+                          over_steps ? "Too many steps (" + std::to_string(step_limit) + ")" : 
+                          "Time limit exceeded after " + std::to_string(steps) + " steps");
+            halted = true;
+            return false;
+        }
+        next_check = SIZE_MAX;
+        if (timed || cancel_flag) next_check = steps + TIPA_BUDGET_CHECK_STEPS;
+        if (step_limit != 0) next_check = std::min(next_check, step_limit + 1);
+        return true;
+    }
+
+    bool parser_context::depth_exceeded()
+    {
+        --depth;
+        if (!halted) set_error({ERR_PARSE_DEPTH, "Maximum nesting depth exceeded"}, "Input too deeply nested");
+        halted = true;
+        return false;
+    }
+
+    /*
+      Before removing tokens that a saved context may need to
+      restore, they are moved in the tail of that context. The
+      'valid' counters are non-decreasing along the stack, so we stop
+      at the first context that is not affected. The tails are kept
+      in reverse order, so that each removal appends to them.
+    */
+    void parser_context::drop_collected(std::size_t n)
+    {
+        if (n >= collected.size()) return;
+        for (auto i = saved.size(); i > cut_depth; --i) {
+            auto &cp = saved[i-1];
+            if (cp.valid <= n) break;
+            for (auto j = cp.valid; j > n; --j) cp.tail.push_back(collected[j-1]);
+            cp.valid = n;
+        }
+        collected.resize(n);
+    }
+
+    void parser_context::drop_values(std::size_t n)
+    {
+        if (n >= values.size()) return;
+        for (auto i = saved.size(); i > cut_depth; --i) {
+            auto &cp = saved[i-1];
+            if (cp.vvalid <= n) break;
+            for (auto j = cp.vvalid; j > n; --j) cp.vtail.push_back(std::move(values[j-1]));
+            cp.vvalid = n;
+        }
+        values.resize(n);
+    }
+
+    std::vector<sem_value> parser_context::take_values()
+    {
+        std::vector<sem_value> v;
+        // the saved contexts may have to restore them
+        if (saved.size() > cut_depth) {
+            v = values;
+            drop_values(0);
+        }
+        else v.swap(values);
+        return v;
     }
 
     token_val parser_context::get_last_token()
@@ -121,7 +791,7 @@ namespace tipa {
     std::vector<token_val> parser_context::collect_tokens()
     {
         auto c = collected;
-        collected.clear();
+        drop_collected(0);
         return c;
     }
 
@@ -129,45 +799,54 @@ namespace tipa {
     // been read)
     std::vector<token_val> parser_context::collect_tokens(int n)
     {
-        std::vector<token_val> v;
-        for (int i=0; i<n; i++) {
-            if (collected.size() == 0) break;
-            v.push_back(collected.back());
-            collected.pop_back();
-        }
-        std::reverse(std::begin(v), std::end(v));
+        std::size_t m = std::min(collected.size(), std::size_t(std::max(n, 0)));
+        std::vector<token_val> v(collected.end() - m, collected.end());
+        drop_collected(collected.size() - m);
         return v;
     }
         
-    void parser_context::set_error(const token_val &tk, const std::string &err_msg)
-    {
-        //error_msg = err_msg;
-        error_message em = {
-            .msg = err_msg,
-            .position = lex.get_pos(),
-            .token = tk,
-            .line = lex.get_currline()
-        };
-        error_stack.push(em);
+    void parser_context::set_error(const token_val &tk, std::string_view err_msg)
+    {
+        // the error that halted the parser stays on top
+        if (halted) return;
+        if (nerrors == error_stack.size()) error_stack.emplace_back();
+        error_message &em = error_stack[nerrors++];
+        em.msg = err_msg;
+        em.position = get_pos();
+        em.token = tk;
+        if (pretok) {
+            // at the end, the last line
+            if (!src_lines.empty()) {
+                auto &sl = tok_index < tok_recs.size() ? src_lines[tok_recs[tok_index].line] : src_lines.back();
+                em.line.assign(src, sl.offset, sl.len);
+            }
+            else em.line.clear();
+        }
+        else em.line = lex.get_currline();
+    }
+
+    void parser_context::conversion_error(const std::string &s)
+    {
+        if (!halted) set_error({ERR_PARSE_CONV, s}, "Cannot convert \"" + s + "\" to the requested type");
+        halted = true;
     }
 
     void parser_context::empty_error_stack()
     {
-        while (!error_stack.empty())
-            error_stack.pop();
+        nerrors = 0;
     }
     
     parser_context::error_message parser_context::get_last_error() const
     {
-        if (!error_stack.empty())
-            return error_stack.top();
+        if (nerrors != 0)
+            return error_stack[nerrors - 1];
         else return error_message();
     }
 
     std::string parser_context::get_error_string() const
     {
-        if (!error_stack.empty())
-            return error_stack.top().token.second;
+        if (nerrors != 0)
+            return error_stack[nerrors - 1].token.second;
         else return "";
     }
 
@@ -175,14 +854,23 @@ namespace tipa {
     
     bool parser_context::eof()
     {
+        if (pretok) return !tok_ready(tok_index);
         return lex.eof();
     }
+
+    std::pair<int, int> parser_context::get_pos() const
+    {
+        if (!pretok) return lex.get_pos();
+        if (tok_index >= tok_recs.size()) return tok_end;
+        auto &r = tok_recs[tok_index];
+        return { src_lines[r.line].nline, int(r.col) };
+    }
     
     std::string parser_context::get_formatted_err_msg()
     {
         std::stringstream err;
-        while (!error_stack.empty()) {
-            auto em = error_stack.top();
+        while (nerrors != 0) {
+            auto &em = error_stack[nerrors - 1];
             err << "@[" << em.position.first 
                 << ":" << em.position.second << "]" << std::endl;
             err << em.line << std::endl;    
@@ -190,7 +878,7 @@ namespace tipa {
             err << "^" << std::endl;
             err << "Error " << -em.token.first << ": " << em.msg << std::endl;
 
-            error_stack.pop();
+            nerrors--;
         }
         return err.str();
     }
@@ -201,7 +889,7 @@ namespace tipa {
     {
         if (collected.size() == 0) throw parse_exc("read_token(): expecting a token");
         token_val tv = collected.back();
-        collected.pop_back();
+        drop_collected(collected.size() - 1);
         return tv.second;
     }
 
@@ -286,30 +974,120 @@ namespace tipa {
     struct impl_rule;
     typedef std::set<impl_rule *> av_set;
 
+    /**
+       The state of a rule in the iterative engine (see
+       run_engine()). The meaning of state and count depends on the
+       rule; both are 0 when the rule starts.
+    */
+    struct engine_frame {
+        const impl_rule *node;
+        unsigned state;
+        unsigned count;
+        // the tokens collected before the rule (see abs_rule::action())
+        std::size_t mark;
+        // the operators waiting for their operands (see optable_rule)
+        std::vector<unsigned> pending;
+        // the position at the beginning of the last instance (see
+        // rep_rule and seplist_rule)
+        std::pair<int, int> pos;
+    };
+
+    /// what a rule asks to the iterative engine
+    typedef enum {EXEC_CALL, EXEC_SUCCESS, EXEC_FAIL} exec_result;
+
+    /// tells if a rule can succeed without consuming input (see
+    /// check_grammar())
+    typedef std::function<bool(const WPtr<impl_rule> &)> nullable_fn;
+
     /** 
         The abstract class for the implementation.
     */
     class abs_rule {
     protected:
-        action_t fun;
+        action_fn fun;
+        span_action_fn span_fun;
+        async_action_fn async_fun;
     public:
         abs_rule() : fun(nullptr) { INC_COUNT; }
         virtual bool parse(parser_context &pc) const = 0;
-        bool action(parser_context &pc);
+
+        /**
+           Parsing in the iterative engine. The rule is invoked first
+           with f.state == 0, and can either complete, or ask the
+           engine to parse a child rule (EXEC_CALL). In the second
+           case, it is invoked again with the result of the child in
+           child_ok. Rules that do not contain other rules can just
+           rely on this default implementation.
+        */
+        virtual exec_result step(parser_context &pc, engine_frame &f,
+                                 bool child_ok, const impl_rule *&child) const {
+            return parse(pc) ? EXEC_SUCCESS : EXEC_FAIL;
+        }
+        // mark is the number of tokens collected before parsing the rule
+        bool action(parser_context &pc, std::size_t mark);
         virtual ~abs_rule() { DEC_COUNT; }
         virtual std::string print(av_set &already_visited) { return std::string(""); }
 
-        void install_action(action_t);
+        void install_action(action_fn);
+        void install_span_action(span_action_fn);
+        void install_async_action(async_action_fn);
+
+        /// calls f on each rule contained in this one (see the
+        /// grammar passes, e.g. left_factor())
+        virtual void for_each_child(const std::function<void(WPtr<impl_rule> &)> &f) {}
+        bool has_action() const { return bool(fun) || bool(span_fun) || bool(async_fun); }
+        /// true if parsing the rule may have effects that are not
+        /// undone by backtracking (an action, a cut, ...)
+        virtual bool has_side_effects() const { return has_action(); }
+
+        /// the structure of the rule, for sharing identical rules (see
+        /// intern()); empty if the rule cannot be shared
+        virtual std::string intern_key() const { return ""; }
+
+        /// true if the rule can succeed without consuming input, given
+        /// the same property of the children (see check_grammar())
+        virtual bool nullable(const nullable_fn &n) const { return false; }
+        /// calls f on the children that can be invoked before this
+        /// rule consumes any input
+        virtual void for_each_leading_child(const nullable_fn &n,
+                                            const std::function<void(WPtr<impl_rule> &)> &f) {}
+        /// true if the rule repeats a child that can succeed without
+        /// consuming input
+        virtual bool repeats_empty(const nullable_fn &n) const { return false; }
     };
 
-    void abs_rule::install_action(action_t f)
+    void abs_rule::install_action(action_fn f)
     {
-        fun = f;
+        fun = std::move(f);
+        span_fun = nullptr;
+        async_fun = nullptr;
     }
 
-    bool abs_rule::action(parser_context &pc)
+    void abs_rule::install_span_action(span_action_fn f)
     {
-        if (fun) {
+        span_fun = std::move(f);
+        fun = nullptr;
+        async_fun = nullptr;
+    }
+
+    void abs_rule::install_async_action(async_action_fn f)
+    {
+        async_fun = std::move(f);
+        fun = nullptr;
+        span_fun = nullptr;
+    }
+
+    bool abs_rule::action(parser_context &pc, std::size_t mark)
+    {
+        if (span_fun) {
+            span_fun(pc, pc.collected_since(mark));
+            pc.drop_tokens(mark);
+        }
+        else if (async_fun) {
+            pc.post_action(async_fun, pc.collected_since(mark));
+            pc.drop_tokens(mark);
+        }
+        else if (fun) {
             INFO_LINE("-- action found");
             fun(pc);
             INFO_LINE("-- action completed");
@@ -323,37 +1101,167 @@ namespace tipa {
     struct impl_rule {
         std::shared_ptr<abs_rule> abs_impl;
 
-        impl_rule() : abs_impl(nullptr) {}
-        impl_rule(abs_rule *r) : abs_impl(r) {}
+        // in the table of intern(); shared is set when the rule has
+        // replaced an identical one, and replaced on that one
+        bool interned;
+        bool shared;
+        bool replaced;
+
+        impl_rule() : abs_impl(nullptr), interned(false), shared(false), replaced(false) {}
+        impl_rule(abs_rule *r) : abs_impl(r), interned(false), shared(false), replaced(false) {}
     
         bool parse(parser_context &pc) const {
             if (!abs_impl) return false;
+            if (!pc.enter_rule()) return false;
+            pc.trace(this, TRACE_ENTER);
 
+            std::size_t mark = pc.collected_count();
             bool f = abs_impl->parse(pc); 
-            if (f) abs_impl->action(pc);
+            if (f && pc.actions_enabled()) abs_impl->action(pc, mark);
+            pc.trace(this, f ? TRACE_EXIT : TRACE_FAIL);
+            pc.exit_rule();
             return f;
         }
-        bool action(parser_context &pc) {
+        bool action(parser_context &pc, std::size_t mark) {
             if (!abs_impl) return false;
-            return abs_impl->action(pc);
+            return abs_impl->action(pc, mark);
+        }
+        void install_action(action_fn f) {
+            abs_impl->install_action(std::move(f));
         }
-        void install_action(action_t f) {
-            abs_impl->install_action(f);
+        void install_span_action(span_action_fn f) {
+            abs_impl->install_span_action(std::move(f));
+        }
+        void install_async_action(async_action_fn f) {
+            abs_impl->install_async_action(std::move(f));
         }
     
     };
 
+    /*
+      Hash-consing. When a rule is passed as a temporary to an
+      operator (so that the new rule owns it), it is replaced by an
+      identical rule created before, if any: identical terminals, and
+      identical rules whose children are all owned (and so, already
+      shared in the same way), are created only once. A rule with an
+      action is never shared, and the rules that are only referenced
+      (the lvalues) are never replaced. The table does not keep the
+      rules alive.
+
+      A named rule passed with std::move() cannot be told apart from
+      a temporary, so it may be shared too. Changing it afterwards
+      (an action, a conversion, an assignment) is still possible if
+      it has not been shared yet: it is removed from the table.
+      Otherwise, the change would affect the other grammars (or, for
+      the replaced rule, no grammar at all), and parse_exc is thrown
+      (see check_unshared()).
+    */
+    namespace {
+        struct intern_table {
+            std::mutex m;
+            std::unordered_map<std::string, std::weak_ptr<impl_rule>> table;
+            std::size_t sweep = 64;
+        };
+
+        intern_table &get_intern_table()
+        {
+            static intern_table t;
+            return t;
+        }
+    }
+
+    static std::shared_ptr<impl_rule> intern(rule &r)
+    {
+        auto p = r.get_pimpl();
+        if (!p->abs_impl || p->abs_impl->has_action()) return p;
+        std::string key = p->abs_impl->intern_key();
+        if (key.empty()) return p;
+
+        auto &t = get_intern_table();
+        std::lock_guard<std::mutex> lock(t.m);
+        auto &x = t.table[key];
+        if (auto q = x.lock()) {
+            if (q != p) {
+                q->shared = true;
+                p->replaced = true;
+            }
+            return q;
+        }
+        x = p;
+        p->interned = true;
+        if (t.table.size() > t.sweep) {
+            // removes the rules that do not exist anymore
+            for (auto i = t.table.begin(); i != t.table.end(); ) 
+                if (i->second.expired()) i = t.table.erase(i);
+                else ++i;
+            t.sweep = 2 * t.table.size() + 64;
+        }
+        return p;
+    }
+
+    // called before a rule is changed by the user (see intern())
+    static void check_unshared(impl_rule *p, const char *fn)
+    {
+        if (!p->interned && !p->replaced) return;
+        auto &t = get_intern_table();
+        std::lock_guard<std::mutex> lock(t.m);
+        if (p->shared || p->replaced)
+            throw parse_exc(std::string("rule::") + fn + "(): the rule has been passed with std::move() "
+                            "and shared with an identical rule; change it before building the grammar, "
+                            "or pass it without std::move()");
+        for (auto i = t.table.begin(); i != t.table.end(); ++i)
+            if (i->second.lock().get() == p) {
+                t.table.erase(i);
+                break;
+            }
+        p->interned = false;
+    }
+
+    // the key of a child in intern_key(): only owned children are
+    // shared
+    static std::string child_key(const WPtr<impl_rule> &x)
+    {
+        if (x.isWeak() == WPTR_WEAK) return "";
+        return std::to_string(reinterpret_cast<std::uintptr_t>(x.get().get()));
+    }
+
+    static std::string child_keys(const char *type, const std::vector< WPtr<impl_rule> > &v)
+    {
+        std::string k = type;
+        for (auto &x : v) {
+            auto c = child_key(x);
+            if (c.empty()) return "";
+            k += "," + c;
+        }
+        return k;
+    }
+
 /* ----------------------------------------------- */
 
     class term_rule : public abs_rule {
         token mytoken;
         bool collect;
+        // if set, the token is converted to a value (see rule::as())
+        value_conv_t conv;
     public:
-        term_rule(const token &tk, bool c = true) : mytoken(tk), collect(c) {}
+        term_rule(const token &tk, bool c = true) : mytoken(tk), collect(c), conv(nullptr) {}
+        void set_value_conv(value_conv_t c) { conv = c; }
         virtual bool parse(parser_context &pc) const;
+        bool same_as(const term_rule &o) const {
+            return mytoken.get_name() == o.mytoken.get_name() && mytoken.get_expr() == o.mytoken.get_expr() &&
+                collect == o.collect && conv == o.conv;
+        }
         std::string print(av_set &av) {
             return std::string("TERM: <") + mytoken.get_expr() + ">"; 
         }
+        virtual std::string intern_key() const {
+            return "T" + std::to_string(mytoken.get_name()) + (collect ? "c" : "n") +
+                std::to_string(reinterpret_cast<std::uintptr_t>(conv)) + ":" + mytoken.get_expr();
+        }
+        virtual bool nullable(const nullable_fn &n) const {
+            std::string empty;
+            return std::regex_search(empty, mytoken.get_regex(), std::regex_constants::match_continuous);
+        }
     };
 
 /* ----------------------------------------------- */
@@ -412,26 +1320,63 @@ namespace tipa {
 
     rule & rule::operator=(const rule &r) 
     {
+        check_unshared(pimpl.get(), "operator=");
         pimpl->abs_impl = r.pimpl->abs_impl;
         return *this;
     }
 
+    rule& rule::set_value_conv(value_conv_t conv)
+    {
+        auto t = dynamic_cast<term_rule *>(pimpl->abs_impl.get());
+        if (!t) throw parse_exc("rule::as(): not a terminal rule");
+        check_unshared(pimpl.get(), "as");
+        t->set_value_conv(conv);
+        return *this;
+    }
+
+    static bool run_engine(const impl_rule *root, parser_context &pc);
+
     bool rule::parse(parser_context &pc) const
     { 
+        if (pc.get_engine() == ENGINE_ITERATIVE) return run_engine(pimpl.get(), pc) && !pc.is_halted();
         bool f = pimpl->parse(pc); 
-        return f;
+        // e.g. an action could not convert a token
+        return f && !pc.is_halted();
     }
     
-    rule& rule::set_action(action_t af)
+    rule& rule::set_action(action_fn af)
     {
-        pimpl->install_action(af);
+        check_unshared(pimpl.get(), "set_action");
+        pimpl->install_action(std::move(af));
         INFO_LINE("Action installed");
         return *this;
     }
+
+    rule& rule::set_span_action(span_action_fn af)
+    {
+        check_unshared(pimpl.get(), "set_span_action");
+        pimpl->install_span_action(std::move(af));
+        return *this;
+    }
+
+    rule& rule::set_async_action(async_action_fn af)
+    {
+        check_unshared(pimpl.get(), "set_async_action");
+        pimpl->install_async_action(std::move(af));
+        return *this;
+    }
     
     bool term_rule::parse(parser_context &pc) const
     {
         INFO_LINE("term_rule::parse() trying " << mytoken.get_expr());
+        // like the actions, the values are not produced in a dry run
+        if (conv && pc.actions_enabled()) {
+            bool ok = true;
+            token_val result = pc.try_token(mytoken, [this, &pc, &ok](std::string_view v) { ok = conv(pc, v); });
+            if (result.first == mytoken.get_name()) return ok;
+            pc.set_error(result, "Terminal rule failed");
+            return false;
+        }
         token_val result = pc.try_token(mytoken);
         INFO_LINE("term_rule::parse() completed on " << result.first);
         if (result.first == mytoken.get_name()) {
@@ -460,9 +1405,25 @@ namespace tipa {
         seq_rule(rule &&a, rule &b); 
         seq_rule(rule &a, rule &&b);
         seq_rule(rule &&a, rule &&b);
+        seq_rule(std::vector< WPtr<impl_rule> > v) : rl(std::move(v)) {}
  
         virtual bool parse(parser_context &pc) const;
+        virtual exec_result step(parser_context &pc, engine_frame &f,
+                                 bool child_ok, const impl_rule *&child) const;
         std::string print(av_set &av);
+        virtual void for_each_child(const std::function<void(WPtr<impl_rule> &)> &f) {
+            for (auto &x : rl) f(x);
+        }
+        std::vector< WPtr<impl_rule> > &elements() { return rl; }
+        virtual std::string intern_key() const { return child_keys("S", rl); }
+        virtual bool nullable(const nullable_fn &n) const { return std::all_of(rl.begin(), rl.end(), n); }
+        virtual void for_each_leading_child(const nullable_fn &n,
+                                            const std::function<void(WPtr<impl_rule> &)> &f) {
+            for (auto &x : rl) {
+                f(x);
+                if (!n(x)) break;
+            }
+        }
     };
 
 /* ----------------------------------------------- */
@@ -475,20 +1436,20 @@ namespace tipa {
 
     seq_rule::seq_rule(rule &&a, rule &b)
     {
-        rl.push_back(WPtr<impl_rule>(a.get_pimpl(), WPTR_STRONG));
+        rl.push_back(WPtr<impl_rule>(intern(a), WPTR_STRONG));
         rl.push_back(WPtr<impl_rule>(b.get_pimpl(), WPTR_WEAK));
     }
 
     seq_rule::seq_rule(rule &a, rule &&b)
     {
         rl.push_back(WPtr<impl_rule>(a.get_pimpl(), WPTR_WEAK));
-        rl.push_back(WPtr<impl_rule>(b.get_pimpl(), WPTR_STRONG));
+        rl.push_back(WPtr<impl_rule>(intern(b), WPTR_STRONG));
     }
 
     seq_rule::seq_rule(rule &&a, rule &&b)
     {
-        rl.push_back(WPtr<impl_rule>(a.get_pimpl(), WPTR_STRONG));
-        rl.push_back(WPtr<impl_rule>(b.get_pimpl(), WPTR_STRONG));
+        rl.push_back(WPtr<impl_rule>(intern(a), WPTR_STRONG));
+        rl.push_back(WPtr<impl_rule>(intern(b), WPTR_STRONG));
     }
 
     bool seq_rule::parse(parser_context &pc) const
@@ -502,6 +1463,7 @@ namespace tipa {
                 if (!spt->parse(pc)) {
                     if (pc.get_error_string() == "EOF" && i == 0) {
                         pc.set_error({ERR_PARSE_SEQ, "Unexpected end of file"}, "Sequential rule rule failed");
+                        pc.restore();
                         return false;
                     }
                     else {
@@ -523,6 +1485,28 @@ namespace tipa {
         return true;
     }
 
+    // f.state is the number of elements tried so far
+    exec_result seq_rule::step(parser_context &pc, engine_frame &f,
+                               bool child_ok, const impl_rule *&child) const
+    {
+        if (f.state == 0) pc.save();
+        else if (!child_ok) {
+            if (pc.get_error_string() == "EOF" && f.state == 1) 
+                pc.set_error({ERR_PARSE_SEQ, "Unexpected end of file"}, "Sequential rule rule failed");
+            pc.restore();
+            return EXEC_FAIL;
+        }
+        if (f.state == rl.size()) {
+            pc.discard_saved();
+            return EXEC_SUCCESS;
+        }
+        auto spt = rl[f.state].get();
+        if (!spt) throw parse_exc("seq_parse: weak pointer error!");
+        child = spt.get();
+        f.state++;
+        return EXEC_CALL;
+    }
+
     std::string seq_rule::print(av_set &av) 
     {
         std::string s("(SEQ: ");
@@ -580,9 +1564,22 @@ namespace tipa {
         alt_rule(rule &&a, rule &b);
         alt_rule(rule &a, rule &&b);
         alt_rule(rule &&a, rule &&b);
+        alt_rule(std::vector< WPtr<impl_rule> > v) : rl(std::move(v)) {}
 
         virtual bool parse(parser_context &pc) const;
+        virtual exec_result step(parser_context &pc, engine_frame &f,
+                                 bool child_ok, const impl_rule *&child) const;
         virtual std::string print(av_set &av);
+        virtual void for_each_child(const std::function<void(WPtr<impl_rule> &)> &f) {
+            for (auto &x : rl) f(x);
+        }
+        std::vector< WPtr<impl_rule> > &elements() { return rl; }
+        virtual std::string intern_key() const { return child_keys("A", rl); }
+        virtual bool nullable(const nullable_fn &n) const { return std::any_of(rl.begin(), rl.end(), n); }
+        virtual void for_each_leading_child(const nullable_fn &n,
+                                            const std::function<void(WPtr<impl_rule> &)> &f) {
+            for (auto &x : rl) f(x);
+        }
     };
 
     alt_rule::alt_rule(rule &a, rule &b)
@@ -593,20 +1590,20 @@ namespace tipa {
 
     alt_rule::alt_rule(rule &&a, rule &b)
     {
-        rl.push_back(WPtr<impl_rule>(a.get_pimpl(), WPTR_STRONG));
+        rl.push_back(WPtr<impl_rule>(intern(a), WPTR_STRONG));
         rl.push_back(WPtr<impl_rule>(b.get_pimpl(), WPTR_WEAK));
     }
 
     alt_rule::alt_rule(rule &a, rule &&b)
     {
         rl.push_back(WPtr<impl_rule>(a.get_pimpl(), WPTR_WEAK));
-        rl.push_back(WPtr<impl_rule>(b.get_pimpl(), WPTR_STRONG));
+        rl.push_back(WPtr<impl_rule>(intern(b), WPTR_STRONG));
     }
 
     alt_rule::alt_rule(rule &&a, rule &&b)
     {
-        rl.push_back(WPtr<impl_rule>(a.get_pimpl(), WPTR_STRONG));
-        rl.push_back(WPtr<impl_rule>(b.get_pimpl(), WPTR_STRONG));
+        rl.push_back(WPtr<impl_rule>(intern(a), WPTR_STRONG));
+        rl.push_back(WPtr<impl_rule>(intern(b), WPTR_STRONG));
     }
 
     bool alt_rule::parse(parser_context &pc) const
@@ -616,9 +1613,13 @@ namespace tipa {
             if (auto spt = x.get()) {
                 if (spt->parse(pc)) {
                     INFO_LINE(" ** ok");
-                    pc.empty_error_stack();
+                    // the alternative may have halted the parser (e.g.
+                    // a conversion error in an action)
+                    if (!pc.is_halted()) pc.empty_error_stack();
                     return true;
                 }
+                // no alternative after a cut
+                if (pc.is_halted()) return false;
             }
             else {
                 throw parse_exc("alt_rule: undefined weak pointer");
@@ -630,6 +1631,29 @@ namespace tipa {
     }
 
 
+    // f.state is the number of alternatives tried so far
+    exec_result alt_rule::step(parser_context &pc, engine_frame &f,
+                               bool child_ok, const impl_rule *&child) const
+    {
+        if (f.state > 0) {
+            if (child_ok) {
+                if (!pc.is_halted()) pc.empty_error_stack();
+                return EXEC_SUCCESS;
+            }
+            // no alternative after a cut
+            if (pc.is_halted()) return EXEC_FAIL;
+        }
+        if (f.state == rl.size()) {
+            pc.set_error({ERR_PARSE_ALT, "None of the alternatives parsed correctly"}, "Alternative rule failed");
+            return EXEC_FAIL;
+        }
+        auto spt = rl[f.state].get();
+        if (!spt) throw parse_exc("alt_rule: undefined weak pointer");
+        child = spt.get();
+        f.state++;
+        return EXEC_CALL;
+    }
+
     std::string alt_rule::print(av_set &av) {
         std::string s ("(ALT : ");
 
@@ -679,6 +1703,8 @@ namespace tipa {
     class null_rule : public abs_rule {
     public:
         null_rule() {}
+        virtual std::string intern_key() const { return "N"; }
+        virtual bool nullable(const nullable_fn &n) const { return true; }
         virtual bool parse(parser_context &pc) const;
     };
 
@@ -691,23 +1717,41 @@ namespace tipa {
 /* ------------------------------------------- */
 
 /*
-  A repetition of zero or one instances of a rule
+  A repetition of a rule, at least min_rep and at most max_rep times
+  (by default, zero or more times)
 */
     class rep_rule : public abs_rule {
         WPtr<impl_rule> rl;
+        unsigned min_rep;
+        unsigned max_rep;
     public:
-        rep_rule(rule &a);
-        rep_rule(rule &&a);
+        rep_rule(rule &a, unsigned min = 0, unsigned max = REP_UNLIMITED);
+        rep_rule(rule &&a, unsigned min = 0, unsigned max = REP_UNLIMITED);
 
         virtual bool parse(parser_context &pc) const;
+        virtual exec_result step(parser_context &pc, engine_frame &f,
+                                 bool child_ok, const impl_rule *&child) const;
         virtual std::string print(av_set &av);
+        virtual void for_each_child(const std::function<void(WPtr<impl_rule> &)> &f) { f(rl); }
+        virtual std::string intern_key() const {
+            return child_keys(("R" + std::to_string(min_rep) + "," + std::to_string(max_rep)).c_str(), {rl});
+        }
+        virtual bool nullable(const nullable_fn &n) const { return min_rep == 0 || n(rl); }
+        virtual void for_each_leading_child(const nullable_fn &n,
+                                            const std::function<void(WPtr<impl_rule> &)> &f) { f(rl); }
+        virtual bool repeats_empty(const nullable_fn &n) const { return max_rep > 1 && n(rl); }
+    private:
+        // completes the repetition after n instances
+        bool complete(parser_context &pc, unsigned n) const;
     };
 
-    rep_rule::rep_rule(rule &a) : rl(WPtr<impl_rule>(a.get_pimpl(), WPTR_WEAK))
+    rep_rule::rep_rule(rule &a, unsigned min, unsigned max) :
+        rl(WPtr<impl_rule>(a.get_pimpl(), WPTR_WEAK)), min_rep(min), max_rep(max)
     {
     }
 
-    rep_rule::rep_rule(rule &&a) : rl(WPtr<impl_rule>(a.get_pimpl(), WPTR_STRONG))
+    rep_rule::rep_rule(rule &&a, unsigned min, unsigned max) :
+        rl(WPtr<impl_rule>(intern(a), WPTR_STRONG)), min_rep(min), max_rep(max)
     {
     }
 
@@ -746,23 +1790,75 @@ namespace tipa {
        the rule.parse() and then checks if the whole file was parsed
        correctly. If so, then returns ok, otherwise it is an error.
 
-       And the repetion rule just returns true ALWAYS. 
+       And the repetion rule just returns true ALWAYS (unless a
+       minimum number of instances is required).
 
        Q: What about the error stack ? 
+
+       The repetition is a loop, so a long sequence of instances does
+       not consume the C++ stack. A failed instance does not consume
+       input, so a saved context is needed only to go back when
+       fewer than min_rep instances (and more than one) are found.
      */
     bool rep_rule::parse(parser_context &pc) const
     {
         INFO("rep_rule::parse() | ");
-        if (rl.get()) {
-            while (rl.get()->parse(pc)) INFO("*");
-            INFO(" end ");
-            // if (pc.get_error_string() != "EOF" && i == 0) return false;
-            // else return true;
+        auto spt = rl.get();
+        if (!spt) throw parse_exc("rep_rule: unvalid weak pointer");
+
+        if (min_rep > 1) pc.save();
+        unsigned n = 0;
+        auto pos = pc.get_pos();
+        while (n < max_rep && spt->parse(pc)) {
+            INFO("*");
+            n++;
+            // an instance that does not consume input would be
+            // repeated forever
+            auto p = pc.get_pos();
+            if (p == pos && n >= min_rep) break;
+            pos = p;
         }
-        else {
-            throw parse_exc("rep_rule: unvalid weak pointer");
+        INFO(" end ");
+        return complete(pc, n);
+    }
+
+    bool rep_rule::complete(parser_context &pc, unsigned n) const
+    {
+        // if the last instance failed after a cut, the repetition fails
+        bool f = n >= min_rep && !pc.is_halted();
+        if (min_rep > 1) {
+            if (f) pc.discard_saved();
+            else pc.restore();
         }
-        return true;
+        return f;
+    }
+
+    // f.count is the number of instances parsed so far
+    exec_result rep_rule::step(parser_context &pc, engine_frame &f,
+                               bool child_ok, const impl_rule *&child) const
+    {
+        auto spt = rl.get();
+        if (!spt) throw parse_exc("rep_rule: unvalid weak pointer");
+
+        if (f.state == 0) {
+            if (min_rep > 1) pc.save();
+            f.state = 1;
+        }
+        else if (child_ok) {
+            f.count++;
+            // an instance that does not consume input would be
+            // repeated forever
+            if (pc.get_pos() == f.pos && f.count >= min_rep) 
+                return complete(pc, f.count) ? EXEC_SUCCESS : EXEC_FAIL;
+        }
+        else return complete(pc, f.count) ? EXEC_SUCCESS : EXEC_FAIL;
+
+        if (f.count < max_rep) {
+            f.pos = pc.get_pos();
+            child = spt.get();
+            return EXEC_CALL;
+        }
+        return complete(pc, f.count) ? EXEC_SUCCESS : EXEC_FAIL;
     }
 
     std::string rep_rule::print(av_set &av) 
@@ -793,6 +1889,631 @@ namespace tipa {
         return rule(s);    
     }
 
+    rule operator+(rule &a) 
+    {
+        auto s = std::make_shared<impl_rule>(new rep_rule(a, 1));
+        return rule(s);    
+    }
+
+    rule operator+(rule &&a) 
+    {
+        auto s = std::make_shared<impl_rule>(new rep_rule(std::move(a), 1));
+        return rule(s);    
+    }
+
+    static void check_repeat(unsigned min, unsigned max)
+    {
+        if (min > max)
+            throw parse_exc("repeat_rule(): the minimum " + std::to_string(min) +
+                            " is greater than the maximum " + std::to_string(max));
+    }
+
+    rule repeat_rule(rule &a, unsigned min, unsigned max) 
+    {
+        check_repeat(min, max);
+        auto s = std::make_shared<impl_rule>(new rep_rule(a, min, max));
+        return rule(s);    
+    }
+
+    rule repeat_rule(rule &&a, unsigned min, unsigned max) 
+    {
+        check_repeat(min, max);
+        auto s = std::make_shared<impl_rule>(new rep_rule(std::move(a), min, max));
+        return rule(s);    
+    }
+
+/* ------------------------------------------- */
+
+/*
+  A list of instances of a rule, separated by instances of a
+  separator rule.
+*/
+    class seplist_rule : public abs_rule {
+        WPtr<impl_rule> rl;
+        WPtr<impl_rule> sep;
+        unsigned min_rep;
+    public:
+        seplist_rule(rule &a, rule &&s, unsigned min) :
+            rl(a.get_pimpl(), WPTR_WEAK), sep(intern(s), WPTR_STRONG), min_rep(min) {}
+        seplist_rule(rule &&a, rule &&s, unsigned min) :
+            rl(intern(a), WPTR_STRONG), sep(intern(s), WPTR_STRONG), min_rep(min) {}
+
+        virtual bool parse(parser_context &pc) const;
+        virtual exec_result step(parser_context &pc, engine_frame &f,
+                                 bool child_ok, const impl_rule *&child) const;
+        virtual std::string print(av_set &av);
+        virtual void for_each_child(const std::function<void(WPtr<impl_rule> &)> &f) { f(rl); f(sep); }
+        virtual std::string intern_key() const {
+            return child_keys(("L" + std::to_string(min_rep)).c_str(), {rl, sep});
+        }
+        virtual bool nullable(const nullable_fn &n) const { return min_rep == 0 || n(rl); }
+        virtual void for_each_leading_child(const nullable_fn &n,
+                                            const std::function<void(WPtr<impl_rule> &)> &f) {
+            f(rl);
+            if (n(rl)) f(sep);
+        }
+        virtual bool repeats_empty(const nullable_fn &n) const { return n(rl) && n(sep); }
+    private:
+        bool complete(parser_context &pc, unsigned n) const;
+    };
+
+    /*
+      Each iteration saves the context once, to go back before the
+      separator in case the element after it does not match.
+    */
+    bool seplist_rule::parse(parser_context &pc) const
+    {
+        INFO("seplist_rule::parse() | ");
+        auto spt = rl.get();
+        auto ssep = sep.get();
+        if (!spt || !ssep) throw parse_exc("seplist_rule: unvalid weak pointer");
+
+        if (min_rep > 1) pc.save();
+        unsigned n = 0;
+        if (spt->parse(pc)) {
+            n++;
+            while (true) {
+                auto pos = pc.get_pos();
+                pc.save();
+                if (!ssep->parse(pc) || !spt->parse(pc)) {
+                    pc.restore();
+                    break;
+                }
+                pc.discard_saved();
+                n++;
+                // neither the separator nor the element consumed input
+                if (pc.get_pos() == pos && n >= min_rep) break;
+            }
+        }
+        INFO(" end ");
+        return complete(pc, n);
+    }
+
+    bool seplist_rule::complete(parser_context &pc, unsigned n) const
+    {
+        bool f = n >= min_rep && !pc.is_halted();
+        if (min_rep > 1) {
+            if (f) pc.discard_saved();
+            else pc.restore();
+        }
+        return f;
+    }
+
+    /* f.state is: 
+       0 at the beginning, 
+       1 after the first element, 
+       2 after a separator,
+       3 after an element following a separator */
+    exec_result seplist_rule::step(parser_context &pc, engine_frame &f,
+                                   bool child_ok, const impl_rule *&child) const
+    {
+        auto spt = rl.get();
+        auto ssep = sep.get();
+        if (!spt || !ssep) throw parse_exc("seplist_rule: unvalid weak pointer");
+
+        switch (f.state) {
+        case 0:
+            if (min_rep > 1) pc.save();
+            f.state = 1;
+            child = spt.get();
+            return EXEC_CALL;
+        case 1:
+            if (!child_ok) break;
+            f.count = 1;
+            f.pos = pc.get_pos();
+            pc.save();
+            f.state = 2;
+            child = ssep.get();
+            return EXEC_CALL;
+        case 2:
+            if (!child_ok) {
+                pc.restore();
+                break;
+            }
+            f.state = 3;
+            child = spt.get();
+            return EXEC_CALL;
+        case 3:
+            if (!child_ok) {
+                pc.restore();
+                break;
+            }
+            pc.discard_saved();
+            f.count++;
+            // neither the separator nor the element consumed input
+            if (pc.get_pos() == f.pos && f.count >= min_rep) break;
+            f.pos = pc.get_pos();
+            pc.save();
+            f.state = 2;
+            child = ssep.get();
+            return EXEC_CALL;
+        }
+        return complete(pc, f.count) ? EXEC_SUCCESS : EXEC_FAIL;
+    }
+
+    std::string seplist_rule::print(av_set &av) 
+    {
+        std::string s = "(LIST :";
+        if (auto spt = rl.get()) {
+            if (av.find(spt.get()) == av.end()) {
+                av.insert(spt.get());
+                s += spt->abs_impl->print(av);
+            }
+            else s += "[visited]";
+        }
+        else s+=" <unvalid> ";
+        if (auto ssep = sep.get()) s += " SEP " + ssep->abs_impl->print(av);
+        return s + ")\n";
+    }
+
+    rule sep_list_rule(rule &r, const std::string &sep, unsigned min)
+    {
+        auto s = std::make_shared<impl_rule>(new seplist_rule(r, rule(sep), min));
+        return rule(s);
+    }
+
+    rule sep_list_rule(rule &&r, const std::string &sep, unsigned min)
+    {
+        auto s = std::make_shared<impl_rule>(new seplist_rule(std::move(r), rule(sep), min));
+        return rule(s);
+    }
+
+    /*
+      Conversion of the digits of an integer, 8 digits at a time
+      (SWAR: SIMD within a register). The 8 characters are loaded in
+      a 64 bits integer, so this requires a little endian machine.
+    */
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define TIPA_SWAR_DIGITS 1
+#endif
+
+#ifdef TIPA_SWAR_DIGITS
+    // number of digits at the beginning of the 8 characters in x
+    static inline unsigned swar_digit_run(uint64_t x)
+    {
+        // the digits become bytes from 0 to 9
+        uint64_t a = x ^ 0x3030303030303030ULL;
+        // the highest bit of a byte is set if it is not a digit
+        uint64_t nd = (((a & 0x7F7F7F7F7F7F7F7FULL) + 0x7676767676767676ULL) | a) & 0x8080808080808080ULL;
+        if (nd == 0) return 8;
+        return __builtin_ctzll(nd) / 8;
+    }
+
+    // the value of the first k (1 to 8) digits in x
+    static inline uint64_t swar_digits_value(uint64_t x, unsigned k)
+    {
+        uint64_t v = (x ^ 0x3030303030303030ULL) << (8 * (8 - k));
+        v = (v * 10) + (v >> 8);
+        v = (((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+             (((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+        return v;
+    }
+#endif
+
+    static const uint64_t pow10_table[] = {
+        1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL
+    };
+
+    typedef enum {NUM_OK, NUM_NONE, NUM_RANGE} num_scan_t;
+
+    static inline bool is_word_char(char c)
+    {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+    }
+
+    /* Scans a number at position pos of v. Like tk_int, the number
+       cannot be followed by a letter or a digit. */
+    template<typename T>
+    static num_scan_t scan_number(std::string_view v, std::size_t &pos, T &out)
+    {
+        const char *first = v.data() + pos;
+        const char *last = v.data() + v.size();
+
+        if constexpr (std::is_floating_point_v<T>) {
+            // only digits: from_chars() also accepts inf and nan
+            const char *d = first;
+            if (d != last && *d == '-') ++d;
+            if (d == last || (*d != '.' && (*d < '0' || *d > '9'))) return NUM_NONE;
+            auto r = std::from_chars(first, last, out);
+            if (r.ptr == first || (r.ptr != last && is_word_char(*r.ptr))) return NUM_NONE;
+            if (r.ec != std::errc()) return NUM_RANGE;
+            pos += r.ptr - first;
+            return NUM_OK;
+        }
+        else {
+            const char *p = first;
+            bool neg = false;
+            if constexpr (std::is_signed_v<T>) {
+                if (p != last && *p == '-') {
+                    neg = true;
+                    ++p;
+                }
+            }
+            const char *d = p;
+            uint64_t acc = 0;
+            while (p != last) {
+#ifdef TIPA_SWAR_DIGITS
+                if (last - p >= 8) {
+                    uint64_t x;
+                    std::memcpy(&x, p, 8);
+                    unsigned k = swar_digit_run(x);
+                    if (k == 0) break;
+                    if (p - d + k <= 18) acc = acc * pow10_table[k] + swar_digits_value(x, k);
+                    p += k;
+                    if (k < 8) break;
+                    continue;
+                }
+#endif
+                if (*p < '0' || *p > '9') break;
+                if (p - d < 18) acc = acc * 10 + (*p - '0');
+                ++p;
+            }
+            if (p == d || (p != last && is_word_char(*p))) return NUM_NONE;
+
+            if (p - d > 18) {
+                // too many digits for the fast path
+                auto r = std::from_chars(first, p, out);
+                if (r.ec != std::errc()) return NUM_RANGE;
+            }
+            else if (neg) {
+                if (acc > uint64_t(std::numeric_limits<T>::max()) + 1) return NUM_RANGE;
+                out = T(0 - acc);
+            }
+            else {
+                if (acc > uint64_t(std::numeric_limits<T>::max())) return NUM_RANGE;
+                out = T(acc);
+            }
+            pos += p - first;
+            return NUM_OK;
+        }
+    }
+
+    /** The rule that parses a list of numbers (see number_list_rule()) */
+    template<typename T>
+    class numlist_rule : public abs_rule {
+        std::vector<T> &out;
+        char sep;
+        unsigned min_rep;
+    public:
+        numlist_rule(std::vector<T> &o, char s, unsigned min) : out(o), sep(s), min_rep(min) {}
+        virtual bool parse(parser_context &pc) const;
+        virtual std::string print(av_set &av) {
+            return std::string("(NUMLIST SEP ") + sep + ")\n";
+        }
+        // the numbers are stored in out
+        virtual bool has_side_effects() const { return true; }
+        virtual bool nullable(const nullable_fn &n) const { return min_rep == 0; }
+    };
+
+    /*
+      The current line is scanned until the list ends or the line
+      ends; then the scanned characters are consumed, and the scan
+      continues on the next line. Within a line, a separator is
+      consumed only together with the following number. At the end
+      of a line, the context is saved before a separator, in case
+      the number is not found on the next line.
+    */
+    template<typename T>
+    bool numlist_rule<T>::parse(parser_context &pc) const
+    {
+        INFO("numlist_rule::parse() | ");
+        bool store = pc.actions_enabled();
+        std::size_t first = out.size();
+        unsigned n = 0;
+        bool want_num = true;
+        bool pending_sep = false;
+        std::string bad_number;
+
+        pc.save();
+        std::string_view v = pc.peek_line();
+        while (!v.empty()) {
+            std::size_t pos = 0, committed = 0;
+            bool stop = false;
+            while (pos < v.size()) {
+                if (want_num) {
+                    T x;
+                    num_scan_t r = scan_number(v, pos, x);
+                    if (r == NUM_RANGE) {
+                        auto e = v.find_first_of(std::string(" \t") + sep, pos);
+                        bad_number = v.substr(pos, e == std::string_view::npos ? e : e - pos);
+                    }
+                    if (r != NUM_OK) {
+                        // after a separator, there may be a comment
+                        stop = r == NUM_RANGE || pos == committed;
+                        break;
+                    }
+                    if (store) out.push_back(x);
+                    n++;
+                    committed = pos;
+                    want_num = false;
+                    if (pending_sep) {
+                        pc.discard_saved();
+                        pending_sep = false;
+                    }
+                }
+                else {
+                    if (v[pos] != sep) break;
+                    pos++;
+                    want_num = true;
+                }
+                while (pos < v.size() && (v[pos] == ' ' || v[pos] == '\t')) pos++;
+            }
+            pc.consume(committed);
+            if (stop) break;
+            if (want_num) {
+                // the number may come after a comment or a new line
+                pc.save();
+                pending_sep = true;
+                pc.consume(pos - committed);
+                v = pc.peek_line();
+            }
+            else {
+                // the separator may come after a comment or a new line
+                v = pc.peek_line();
+                if (!v.empty() && v[0] != sep) break;
+            }
+        }
+        // the last separator is not followed by a number
+        if (pending_sep) pc.restore();
+
+        if (!bad_number.empty()) {
+            if (store) out.resize(first);
+            pc.conversion_error(bad_number);
+            pc.restore();
+            return false;
+        }
+        if (n < min_rep || pc.is_halted()) {
+            if (store) out.resize(first);
+            pc.restore();
+            pc.set_error({ERR_PARSE_SEQ, "Expecting a number"}, "Number list rule failed");
+            return false;
+        }
+        pc.discard_saved();
+        return true;
+    }
+
+    template<typename T>
+    rule number_list_rule(std::vector<T> &out, char sep, unsigned min)
+    {
+        auto s = std::make_shared<impl_rule>(new numlist_rule<T>(out, sep, min));
+        return rule(s);
+    }
+
+    template rule number_list_rule(std::vector<signed char> &, char, unsigned);
+    template rule number_list_rule(std::vector<unsigned char> &, char, unsigned);
+    template rule number_list_rule(std::vector<short> &, char, unsigned);
+    template rule number_list_rule(std::vector<unsigned short> &, char, unsigned);
+    template rule number_list_rule(std::vector<int> &, char, unsigned);
+    template rule number_list_rule(std::vector<unsigned> &, char, unsigned);
+    template rule number_list_rule(std::vector<long> &, char, unsigned);
+    template rule number_list_rule(std::vector<unsigned long> &, char, unsigned);
+    template rule number_list_rule(std::vector<long long> &, char, unsigned);
+    template rule number_list_rule(std::vector<unsigned long long> &, char, unsigned);
+    template rule number_list_rule(std::vector<float> &, char, unsigned);
+    template rule number_list_rule(std::vector<double> &, char, unsigned);
+
+    /**
+       The operator table rule (see operator_table_rule()). The
+       operands are parsed by the primary rule, and the operators are
+       parsed with a single regular expression (one for the prefix
+       operators, one for the binary operators). The precedences are
+       resolved with a stack of pending operators (as in the
+       shunting-yard algorithm), so each operand is parsed only once,
+       independently of the number of precedence levels.
+    */
+    class optable_rule : public abs_rule {
+        WPtr<impl_rule> primary;
+        std::vector<op_entry> ops;
+        token prefix_tk, binary_tk;
+        std::map<std::string, unsigned> prefix_idx, binary_idx;
+
+        void build();
+        bool match(parser_context &pc, const token &tk,
+                   const std::map<std::string, unsigned> &idx, unsigned &i) const;
+        bool next_binary(parser_context &pc, engine_frame &f) const;
+        void reduce(parser_context &pc, engine_frame &f) const;
+        exec_result complete(parser_context &pc, engine_frame &f) const;
+    public:
+        optable_rule(rule &p, const std::vector<op_entry> &t) :
+            primary(p.get_pimpl(), WPTR_WEAK), ops(t),
+            prefix_tk(tk_char), binary_tk(tk_char) { build(); }
+        optable_rule(rule &&p, const std::vector<op_entry> &t) :
+            primary(intern(p), WPTR_STRONG), ops(t),
+            prefix_tk(tk_char), binary_tk(tk_char) { build(); }
+
+        virtual bool parse(parser_context &pc) const;
+        virtual exec_result step(parser_context &pc, engine_frame &f,
+                                 bool child_ok, const impl_rule *&child) const;
+        virtual std::string print(av_set &av);
+        virtual void for_each_child(const std::function<void(WPtr<impl_rule> &)> &f) { f(primary); }
+        virtual bool nullable(const nullable_fn &n) const { return n(primary); }
+        virtual void for_each_leading_child(const nullable_fn &n,
+                                            const std::function<void(WPtr<impl_rule> &)> &f) { f(primary); }
+        virtual bool has_side_effects() const {
+            return has_action() || std::any_of(ops.begin(), ops.end(), [](const op_entry &o) { return bool(o.action); });
+        }
+    };
+
+    // a regular expression matching any of the symbols
+    static token symbols_token(std::vector<std::string> syms)
+    {
+        // the first alternative that matches is taken: longest first
+        std::sort(syms.begin(), syms.end(),
+                  [](const std::string &a, const std::string &b) { return a.size() > b.size(); });
+        std::string e;
+        for (auto &x : syms) {
+            if (!e.empty()) e += "|";
+            e += padding(x);
+            // a word operator is not the prefix of an identifier
+            if (std::isalnum(x.back()) || x.back() == '_') e += "\\b";
+        }
+        return token(tk_char.get_name(), "(?:" + e + ")");
+    }
+
+    void optable_rule::build()
+    {
+        std::vector<std::string> pre, bin;
+        for (unsigned i = 0; i < ops.size(); ++i) {
+            if (ops[i].sym.empty()) throw parse_exc("operator_table_rule: empty operator");
+            auto &idx = ops[i].assoc == OP_PREFIX ? prefix_idx : binary_idx;
+            auto &syms = ops[i].assoc == OP_PREFIX ? pre : bin;
+            if (!idx.insert({ops[i].sym, i}).second)
+                throw parse_exc("operator_table_rule: operator " + ops[i].sym + " defined twice");
+            syms.push_back(ops[i].sym);
+        }
+        if (!pre.empty()) prefix_tk = symbols_token(pre);
+        if (!bin.empty()) binary_tk = symbols_token(bin);
+    }
+
+    bool optable_rule::match(parser_context &pc, const token &tk,
+                             const std::map<std::string, unsigned> &idx, unsigned &i) const
+    {
+        if (idx.empty()) return false;
+        token_val tv = pc.try_token(tk);
+        if (tv.first != tk.get_name()) return false;
+        i = idx.at(tv.second);
+        return true;
+    }
+
+    // the operator on top of the stack has all its operands
+    void optable_rule::reduce(parser_context &pc, engine_frame &f) const
+    {
+        const op_entry &op = ops[f.pending.back()];
+        f.pending.pop_back();
+        if (op.action && pc.actions_enabled()) op.action(pc);
+    }
+
+    /* Tries to read a binary operator after an operand. If it is
+       found, the context saved before it is kept until the following
+       operand has been parsed. The pending operators completed by
+       the new one are reduced before the context is saved: if the
+       following operand is missing, restoring the context must not
+       undo their actions. */
+    bool optable_rule::next_binary(parser_context &pc, engine_frame &f) const
+    {
+        unsigned b;
+        pc.save();
+        bool found = match(pc, binary_tk, binary_idx, b);
+        pc.restore();
+        if (!found) return false;
+
+        // the pending operators with higher precedence are complete
+        while (!f.pending.empty()) {
+            const op_entry &t = ops[f.pending.back()];
+            if (t.prec > ops[b].prec ||
+                (t.prec == ops[b].prec && (ops[b].assoc == OP_LEFT || t.assoc == OP_PREFIX)))
+                reduce(pc, f);
+            else break;
+        }
+        // the operator is read again (the lexer caches the attempt)
+        pc.save();
+        match(pc, binary_tk, binary_idx, b);
+        f.pending.push_back(b);
+        return true;
+    }
+
+    exec_result optable_rule::complete(parser_context &pc, engine_frame &f) const
+    {
+        while (!f.pending.empty()) reduce(pc, f);
+        pc.discard_saved();
+        return EXEC_SUCCESS;
+    }
+
+    /* f.count is the number of operands parsed so far. After a
+       binary operator, the rule always waits for an operand; if the
+       operand is not there, the rule goes back before the operator
+       and completes. */
+    exec_result optable_rule::step(parser_context &pc, engine_frame &f,
+                                   bool child_ok, const impl_rule *&child) const
+    {
+        auto spt = primary.get();
+        if (!spt) throw parse_exc("optable_rule: unvalid weak pointer");
+
+        if (f.state == 0) {
+            pc.save();
+            f.state = 1;
+        }
+        else if (!child_ok) {
+            if (f.count == 0 || pc.is_halted()) {
+                if (f.count > 0) pc.restore();
+                pc.restore();
+                return EXEC_FAIL;
+            }
+            pc.restore();
+            while (ops[f.pending.back()].assoc == OP_PREFIX) f.pending.pop_back();
+            f.pending.pop_back();
+            return complete(pc, f);
+        }
+        else {
+            if (f.count > 0) pc.discard_saved();
+            f.count++;
+            if (!next_binary(pc, f)) return complete(pc, f);
+        }
+
+        unsigned i;
+        while (match(pc, prefix_tk, prefix_idx, i)) f.pending.push_back(i);
+        child = spt.get();
+        return EXEC_CALL;
+    }
+
+    bool optable_rule::parse(parser_context &pc) const
+    {
+        INFO("optable_rule::parse() | ");
+        engine_frame f{nullptr, 0, 0, 0};
+        const impl_rule *child = nullptr;
+        bool ok = false;
+        exec_result r;
+        while ((r = step(pc, f, ok, child)) == EXEC_CALL) ok = child->parse(pc);
+        return r == EXEC_SUCCESS;
+    }
+
+    std::string optable_rule::print(av_set &av)
+    {
+        std::string s = "(OPTABLE :";
+        if (auto spt = primary.get()) {
+            if (av.find(spt.get()) == av.end()) {
+                av.insert(spt.get());
+                s += spt->abs_impl->print(av);
+            }
+            else s += "[visited]";
+        }
+        else s+=" <unvalid> ";
+        for (auto &op : ops) s += " " + op.sym;
+        return s + ")\n";
+    }
+
+    rule operator_table_rule(rule &primary, const std::vector<op_entry> &ops)
+    {
+        auto s = std::make_shared<impl_rule>(new optable_rule(primary, ops));
+        return rule(s);
+    }
+
+    rule operator_table_rule(rule &&primary, const std::vector<op_entry> &ops)
+    {
+        auto s = std::make_shared<impl_rule>(new optable_rule(std::move(primary), ops));
+        return rule(s);
+    }
+
     class extr_rule : public abs_rule {
         std::string open_sym;
         std::string close_sym;
@@ -830,12 +2551,28 @@ namespace tipa {
         }
     };
 
+    /** The cut rule (see cut()) */
+    class cut_rule : public abs_rule {
+    public:
+        cut_rule() {}
+        virtual std::string intern_key() const { return "C"; }
+        virtual bool nullable(const nullable_fn &n) const { return true; }
+        virtual bool has_side_effects() const { return true; }
+        virtual bool parse(parser_context &pc) const {
+            if (pc.actions_enabled()) pc.commit();
+            return true;
+        }
+        std::string print(av_set &av) { return std::string("CUT"); }
+    };
+
     class keyword_rule : public abs_rule {
         std::string kw;
         term_rule rl;
         bool collect_flag;
     public:
         keyword_rule(const std::string &key, bool collect) : kw(key), rl(tk_ident, true), collect_flag(collect) {}
+        bool same_as(const keyword_rule &o) const { return kw == o.kw && collect_flag == o.collect_flag; }
+        virtual std::string intern_key() const { return std::string("K") + (collect_flag ? "c" : "n") + kw; }
 
         virtual bool parse(parser_context &pc) const;
         virtual std::string print(av_set &av);
@@ -864,6 +2601,176 @@ namespace tipa {
     }
 
 
+    /*
+      A set of keywords, with a perfect hash: the table has a power of
+      two size, and the seed of the hash function is chosen so that
+      the keywords do not collide. Therefore, an identifier is looked
+      up with one hash and one comparison.
+    */
+    class keyword_table {
+        std::vector<std::string> keys;
+        std::vector<int> slots;
+        std::uint32_t seed;
+
+        static std::uint32_t hash(std::string_view s, std::uint32_t seed) {
+            std::uint32_t h = 2166136261u ^ seed;
+            for (unsigned char c : s) h = (h ^ c) * 16777619u;
+            return h ^ (h >> 15);
+        }
+        bool build(std::size_t size, std::uint32_t sd);
+    public:
+        keyword_table(const std::vector<std::string> &k);
+
+        int find(std::string_view s) const {
+            int i = slots[hash(s, seed) & (slots.size() - 1)];
+            return (i >= 0 && keys[i] == s) ? i : -1;
+        }
+        // reads an identifier, and returns the index of the keyword
+        // (or -1, and the context is not changed)
+        int match(parser_context &pc, bool collect) const;
+        const std::vector<std::string> &get_keys() const { return keys; }
+    };
+
+    keyword_table::keyword_table(const std::vector<std::string> &k) : keys(k), seed(0)
+    {
+        if (keys.empty()) throw parse_exc("keywords(): the list of keywords is empty");
+        const std::regex &ident = tk_ident.get_regex();
+        for (std::size_t i = 0; i < keys.size(); i++) {
+            if (!std::regex_match(keys[i], ident))
+                throw parse_exc("keywords(): \"" + keys[i] + "\" is not an identifier");
+            if (std::find(keys.begin(), keys.begin() + i, keys[i]) != keys.begin() + i)
+                throw parse_exc("keywords(): \"" + keys[i] + "\" is repeated");
+        }
+        std::size_t size = 1;
+        while (size < 2 * keys.size()) size *= 2;
+        while (true) {
+            for (std::uint32_t sd = 0; sd < 64; sd++) 
+                if (build(size, sd)) return;
+            size *= 2;
+        }
+    }
+
+    bool keyword_table::build(std::size_t size, std::uint32_t sd)
+    {
+        slots.assign(size, -1);
+        seed = sd;
+        for (std::size_t i = 0; i < keys.size(); i++) {
+            auto &x = slots[hash(keys[i], seed) & (size - 1)];
+            if (x >= 0) return false;
+            x = i;
+        }
+        return true;
+    }
+
+    int keyword_table::match(parser_context &pc, bool collect) const
+    {
+        int k = -1;
+        pc.save();
+        token_val result = pc.try_token(tk_ident, [this, &k](std::string_view v) { k = find(v); });
+        if (result.first == tk_ident.get_name() && k >= 0) {
+            pc.discard_saved();
+            if (collect) pc.push_token({tk_ident.get_name(), keys[k]});
+            return k;
+        }
+        pc.restore();
+        if (result.first != tk_ident.get_name()) pc.set_error(result, "Terminal rule failed");
+        return -1;
+    }
+
+    class keyword_set_rule : public abs_rule {
+        keyword_table table;
+        bool collect_flag;
+    public:
+        keyword_set_rule(const std::vector<std::string> &keys, bool collect) : 
+            table(keys), collect_flag(collect) {}
+
+        virtual bool parse(parser_context &pc) const { return table.match(pc, collect_flag) >= 0; }
+        virtual std::string print(av_set &av);
+    };
+
+    std::string keyword_set_rule::print(av_set &av)
+    {
+        std::string s("TERM: <");
+        for (auto &k : table.get_keys()) s += (s.size() > 7 ? "|" : "") + k;
+        return s + ">";
+    }
+
+    class keyword_switch_rule : public abs_rule {
+        keyword_table table;
+        bool collect_flag;
+        std::vector< WPtr<impl_rule> > rl;
+    public:
+        keyword_switch_rule(const std::vector<std::string> &keys, bool collect) : 
+            table(keys), collect_flag(collect) {}
+        void add(keyword_case c) {
+            rl.push_back(c.owned ? WPtr<impl_rule>(intern(c.r), WPTR_STRONG) : WPtr<impl_rule>(c.r.get_pimpl(), WPTR_WEAK));
+        }
+
+        virtual bool parse(parser_context &pc) const;
+        virtual exec_result step(parser_context &pc, engine_frame &f,
+                                 bool child_ok, const impl_rule *&child) const;
+        virtual std::string print(av_set &av);
+        virtual void for_each_child(const std::function<void(WPtr<impl_rule> &)> &f) {
+            for (auto &x : rl) f(x);
+        }
+    };
+
+    bool keyword_switch_rule::parse(parser_context &pc) const
+    {
+        pc.save();
+        int k = table.match(pc, collect_flag);
+        if (k < 0) {
+            pc.restore();
+            return false;
+        }
+        auto spt = rl[k].get();
+        if (!spt) throw parse_exc("keyword_switch: weak pointer error!");
+        if (spt->parse(pc)) {
+            pc.discard_saved();
+            return true;
+        }
+        pc.restore();
+        return false;
+    }
+
+    exec_result keyword_switch_rule::step(parser_context &pc, engine_frame &f,
+                                          bool child_ok, const impl_rule *&child) const
+    {
+        if (f.state == 1) {
+            if (child_ok) pc.discard_saved();
+            else pc.restore();
+            return child_ok ? EXEC_SUCCESS : EXEC_FAIL;
+        }
+        pc.save();
+        int k = table.match(pc, collect_flag);
+        if (k < 0) {
+            pc.restore();
+            return EXEC_FAIL;
+        }
+        auto spt = rl[k].get();
+        if (!spt) throw parse_exc("keyword_switch: weak pointer error!");
+        child = spt.get();
+        f.state = 1;
+        return EXEC_CALL;
+    }
+
+    std::string keyword_switch_rule::print(av_set &av)
+    {
+        std::string s("(SWITCH: ");
+        for (std::size_t i = 0; i < rl.size(); i++) {
+            s += table.get_keys()[i] + " -> ";
+            if (auto spt = rl[i].get()) {
+                if (av.find(spt.get()) == av.end()) {
+                    av.insert(spt.get());
+                    s += spt->abs_impl->print(av);
+                }
+                else s += "[visited]";
+            }
+            s += " | ";
+        }
+        return s + ")\n";
+    }
+
     rule extract_rule(const std::string &op, const std::string &cl, bool coll)
     {
         auto s = std::make_shared<impl_rule>(new extr_rule(op, cl, coll));
@@ -888,12 +2795,34 @@ namespace tipa {
         return rule(s);
     }
 
+    rule keywords(const std::vector<std::string> &keys, bool collect)
+    {
+        auto s = std::make_shared<impl_rule>(new keyword_set_rule(keys, collect));
+        return rule(s);
+    }
+
+    rule keyword_switch(const std::vector<keyword_case> &cases, bool collect)
+    {
+        std::vector<std::string> keys;
+        for (auto &c : cases) keys.push_back(c.key);
+        auto p = new keyword_switch_rule(keys, collect);
+        auto s = std::make_shared<impl_rule>(p);
+        for (auto &c : cases) p->add(c);
+        return rule(s);
+    }
+
     rule null()
     {
         auto s = std::make_shared<impl_rule>(new null_rule);
         return rule(s);
     }
 
+    rule cut()
+    {
+        auto s = std::make_shared<impl_rule>(new cut_rule);
+        return rule(s);
+    }
+
 
     rule operator-(rule &a)
     {
@@ -916,15 +2845,341 @@ namespace tipa {
         return root;
     }
 
+
+    /*
+      The iterative engine: the rules being parsed are kept in a
+      vector of frames, and each rule tells the engine which child to
+      parse next (see abs_rule::step()). The actions are invoked as
+      in impl_rule::parse().
+    */
+    static bool run_engine(const impl_rule *root, parser_context &pc)
+    {
+        std::vector<engine_frame> stack;
+        if (!pc.enter_rule()) return false;
+        pc.trace(root, TRACE_ENTER);
+        stack.push_back({root, 0, 0, pc.collected_count()});
+
+        bool result = false;
+        while (!stack.empty()) {
+            engine_frame &f = stack.back();
+            const impl_rule *child = nullptr;
+            exec_result r = EXEC_FAIL;
+            if (f.node->abs_impl) r = f.node->abs_impl->step(pc, f, result, child);
+
+            if (r == EXEC_CALL) {
+                // if the maximum depth is exceeded, the child fails
+                if (pc.enter_rule()) {
+                    pc.trace(child, TRACE_ENTER);
+                    stack.push_back({child, 0, 0, pc.collected_count()});
+                }
+                else result = false;
+                continue;
+            }
+            result = (r == EXEC_SUCCESS);
+            if (result && pc.actions_enabled()) f.node->abs_impl->action(pc, f.mark);
+            pc.trace(f.node, result ? TRACE_EXIT : TRACE_FAIL);
+            stack.pop_back();
+            pc.exit_rule();
+        }
+        return result;
+    }
     
+/* ----------------------------------------------- */
+
+    /*
+      Left factoring. Consecutive alternatives that start with the
+      same rules,
+
+         (p1 >> p2 >> a) | (p1 >> p2 >> b) | c
+
+      are rewritten as
+
+         (p1 >> p2 >> (a | b)) | c
+
+      which parses the same inputs, because the rules are
+      deterministic: if p1 >> p2 matched for the first alternative,
+      it matches in the same way for the second one. A rule can be
+      moved out of the alternatives only if parsing it twice is the
+      same as parsing it once, i.e. it has no side effects (actions,
+      cuts, ...), and an alternative can be split only if it has no
+      action, because the action would not receive the tokens of the
+      prefix anymore.
+    */
+    namespace {
+        typedef std::vector< WPtr<impl_rule> > rule_list;
+
+        template<typename R>
+        R *rule_as(const WPtr<impl_rule> &x)
+        {
+            auto spt = x.get();
+            return spt ? dynamic_cast<R *>(spt->abs_impl.get()) : nullptr;
+        }
+
+        // the elements of a sequence, or of an alternation: the
+        // nested ones without actions are expanded
+        template<typename R>
+        void expand(const WPtr<impl_rule> &x, rule_list &out)
+        {
+            auto r = rule_as<R>(x);
+            if (r && !r->has_action()) 
+                for (auto &y : r->elements()) expand<R>(y, out);
+            else out.push_back(x);
+        }
+
+        bool no_side_effects(impl_rule *p, av_set &av)
+        {
+            if (!p) return false;
+            if (!av.insert(p).second) return true;
+            // undefined rules cannot be checked
+            if (!p->abs_impl || p->abs_impl->has_side_effects()) return false;
+            bool ok = true;
+            p->abs_impl->for_each_child([&ok, &av](WPtr<impl_rule> &c) {
+                    if (ok) ok = no_side_effects(c.get().get(), av);
+                });
+            return ok;
+        }
+
+        bool no_side_effects(const WPtr<impl_rule> &x)
+        {
+            av_set av;
+            return no_side_effects(x.get().get(), av);
+        }
+
+        // the same rule, or two equal terminals
+        bool same_rule(const WPtr<impl_rule> &a, const WPtr<impl_rule> &b)
+        {
+            auto pa = a.get(), pb = b.get();
+            if (!pa || !pb || !pa->abs_impl || !pb->abs_impl) return false;
+            if (pa == pb) return true;
+            if (pa->abs_impl->has_action() || pb->abs_impl->has_action()) return false;
+            if (auto ta = dynamic_cast<term_rule *>(pa->abs_impl.get()))
+                if (auto tb = dynamic_cast<term_rule *>(pb->abs_impl.get())) 
+                    return ta->same_as(*tb);
+            if (auto ka = dynamic_cast<keyword_rule *>(pa->abs_impl.get()))
+                if (auto kb = dynamic_cast<keyword_rule *>(pb->abs_impl.get())) 
+                    return ka->same_as(*kb);
+            return false;
+        }
+
+        WPtr<impl_rule> make_node(abs_rule *r)
+        {
+            return WPtr<impl_rule>(std::make_shared<impl_rule>(r), WPTR_STRONG);
+        }
+
+        std::string describe(const rule_list &l)
+        {
+            std::string s;
+            for (auto &x : l) {
+                av_set av;
+                if (s.size() > 0) s += " >> ";
+                s += x.get()->abs_impl->print(av);
+            }
+            return s;
+        }
+
+        void factor(alt_rule *alt, std::vector<std::string> &report)
+        {
+            rule_list branches;
+            for (auto &x : alt->elements()) expand<alt_rule>(x, branches);
+            std::vector<rule_list> seqs(branches.size());
+            for (std::size_t i = 0; i < branches.size(); i++) expand<seq_rule>(branches[i], seqs[i]);
+
+            rule_list result;
+            bool changed = false;
+            std::size_t i = 0;
+            while (i < branches.size()) {
+                std::size_t j = i + 1;
+                while (j < branches.size() && same_rule(seqs[j][0], seqs[i][0])) j++;
+                if (j - i < 2 || !no_side_effects(seqs[i][0])) {
+                    for (; i < j; i++) result.push_back(branches[i]);
+                    continue;
+                }
+                // the longest common prefix
+                std::size_t k = 1;
+                bool more = true;
+                while (more) {
+                    for (auto m = i; m < j && more; m++) 
+                        more = seqs[m].size() > k && same_rule(seqs[m][k], seqs[i][k]);
+                    if (more) more = no_side_effects(seqs[i][k]);
+                    if (more) k++;
+                }
+                rule_list prefix(seqs[i].begin(), seqs[i].begin() + k);
+                rule_list rests;
+                for (auto m = i; m < j; m++) {
+                    rule_list rest(seqs[m].begin() + k, seqs[m].end());
+                    if (rest.size() == 0) rests.push_back(make_node(new null_rule));
+                    else if (rest.size() == 1) rests.push_back(rest[0]);
+                    else rests.push_back(make_node(new seq_rule(rest)));
+                }
+                report.push_back("alternatives " + std::to_string(i + 1) + "-" + std::to_string(j) +
+                                 " of " + std::to_string(branches.size()) + " share the prefix " + describe(prefix));
+                auto inner = new alt_rule(rests);
+                factor(inner, report);
+                prefix.push_back(make_node(inner));
+                result.push_back(make_node(new seq_rule(prefix)));
+                changed = true;
+                i = j;
+            }
+            if (changed) alt->elements() = result;
+        }
+
+        void left_factor(impl_rule *p, av_set &av, std::vector<std::string> &report)
+        {
+            if (!p || !av.insert(p).second || !p->abs_impl) return;
+            // a shared rule may belong to other grammars
+            if (auto alt = dynamic_cast<alt_rule *>(p->abs_impl.get())) 
+                if (!p->interned) factor(alt, report);
+            p->abs_impl->for_each_child([&av, &report](WPtr<impl_rule> &c) {
+                    left_factor(c.get().get(), av, report);
+                });
+        }
+    }
+
+    namespace {
+        void count_nodes(impl_rule *p, av_set &av)
+        {
+            if (!p || !av.insert(p).second || !p->abs_impl) return;
+            p->abs_impl->for_each_child([&av](WPtr<impl_rule> &c) { count_nodes(c.get().get(), av); });
+        }
+    }
+
+    std::size_t count_nodes(rule &root)
+    {
+        av_set av;
+        count_nodes(root.get_pimpl().get(), av);
+        return av.size();
+    }
+
+    namespace {
+        void collect_nodes(impl_rule *p, std::vector<impl_rule *> &v, av_set &av)
+        {
+            if (!p || !av.insert(p).second) return;
+            v.push_back(p);
+            if (p->abs_impl) 
+                p->abs_impl->for_each_child([&v, &av](WPtr<impl_rule> &c) { collect_nodes(c.get().get(), v, av); });
+        }
+
+        std::string short_print(impl_rule *p)
+        {
+            av_set av;
+            std::string s = p->abs_impl->print(av);
+            std::replace(s.begin(), s.end(), '\n', ' ');
+            if (s.size() > 60) s = s.substr(0, 57) + "...";
+            return s;
+        }
+
+        // colour: 1 while visiting the rules invoked at the beginning
+        // of p, 2 when done
+        void find_left_recursion(impl_rule *p, const nullable_fn &n, std::map<impl_rule *, int> &colour,
+                                 std::vector<std::string> &report)
+        {
+            colour[p] = 1;
+            p->abs_impl->for_each_leading_child(n, [&](WPtr<impl_rule> &c) {
+                    auto q = c.get().get();
+                    if (!q || !q->abs_impl) return;
+                    if (colour[q] == 1) 
+                        report.push_back("left recursion: the rule " + short_print(q) + 
+                                         " can invoke itself without consuming input");
+                    else if (colour[q] == 0) find_left_recursion(q, n, colour, report);
+                });
+            colour[p] = 2;
+        }
+    }
+
+    std::vector<std::string> check_grammar(rule &root)
+    {
+        std::vector<impl_rule *> nodes;
+        av_set av;
+        collect_nodes(root.get_pimpl().get(), nodes, av);
+
+        // the nullable rules, computed as a fixed point
+        std::map<impl_rule *, bool> null;
+        nullable_fn n = [&null](const WPtr<impl_rule> &x) { return null[x.get().get()]; };
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (auto p : nodes) 
+                if (p->abs_impl && !null[p] && p->abs_impl->nullable(n)) {
+                    null[p] = true;
+                    changed = true;
+                }
+        }
+
+        std::vector<std::string> report;
+        for (auto p : nodes) 
+            if (p->abs_impl && p->abs_impl->repeats_empty(n))
+                report.push_back("the repetition " + short_print(p) + 
+                                 " contains a rule that can succeed without consuming input");
+
+        std::map<impl_rule *, int> colour;
+        for (auto p : nodes) 
+            if (p->abs_impl && colour[p] == 0) find_left_recursion(p, n, colour, report);
+        return report;
+    }
+
+    void parser_context::dump_trace(std::ostream &os) const
+    {
+        static const char *kinds[] = {"enter", "exit ", "fail "};
+        auto events = get_trace();
+        if (trace_count > events.size()) 
+            os << "(" << trace_count - events.size() << " older events dropped)" << std::endl;
+        // the same rules appear many times
+        std::map<const impl_rule *, std::string> names;
+        for (auto &e : events) {
+            auto &name = names[e.rule];
+            if (name.empty()) 
+                name = e.rule->abs_impl ? short_print(const_cast<impl_rule *>(e.rule)) : "<empty>";
+            os << std::setw(12) << e.time / 1000 << " us " 
+               << std::setw(5) << e.line << ":" << std::left << std::setw(4) << e.col << std::right
+               << std::string(std::min<std::size_t>(e.depth, 40), ' ') 
+               << kinds[e.kind] << " " << name << std::endl;
+        }
+    }
+
+    void parser_context::trace_failure() const
+    {
+        if (trace_dump) dump_trace(*trace_dump);
+    }
+
+    std::vector<std::string> left_factor(rule &root)
+    {
+        std::vector<std::string> report;
+        av_set av;
+        left_factor(root.get_pimpl().get(), av, report);
+        return report;
+    }
+
     bool parse_all(const rule &r, parser_context &pc)
     {
         bool f = r.parse(pc);
+        pc.wait_actions();
         bool e = pc.eof();
+        if (!f || !e) pc.trace_failure();
         if (!e) return false;
         else return f;
     }
 
+    bool parse_all(const rule &r, std::string_view s)
+    {
+        // a context of each thread, private to this function so that
+        // it keeps the default configuration (a context of the pool
+        // may have been configured by its previous user); a nested
+        // call (from an action) uses a new one
+        static thread_local parser_context pc;
+        static thread_local bool busy = false;
+        if (busy) {
+            parser_context nested;
+            nested.set_input(s);
+            return parse_all(r, nested);
+        }
+        struct guard {
+            guard() { busy = true; }
+            ~guard() { pc.reset(); busy = false; }
+        } g;
+        pc.set_input(s);
+        return parse_all(r, pc);
+    }
+
 
 }
 
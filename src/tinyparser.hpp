@@ -24,20 +24,152 @@
 #include <memory>
 #include <functional>
 #include <exception>
+#include <any>
+#include <algorithm>
+#include <new>
+#include <cstddef>
+#include <utility>
+#include <charconv>
+#include <type_traits>
+#include <string_view>
+#include <cstdint>
+#include <chrono>
+#include <atomic>
+#include <iosfwd>
 #include <lexer.hpp>
 
 #define ERR_PARSE_SEQ   -100
 #define ERR_PARSE_ALT   -101
+#define ERR_PARSE_CUT   -102
+#define ERR_PARSE_DEPTH -103
+#define ERR_PARSE_CONV  -104
+#define ERR_PARSE_BUDGET -105
+#define ERR_PARSE_CANCELLED -106
+#define ERR_PARSE_LOOKBACK -107
+
+/// no upper bound to the number of repetitions (see repeat_rule())
+#define REP_UNLIMITED   (~0u)
+
+/// number of lines that the lexer thread can split ahead of the
+/// parser (see parser_context::pretokenize())
+#define TIPA_PIPE_LINES 256
+
+/// number of tokens that a commit can drop from the array of the
+/// pretokenized mode before it is shrunk (see parser_context::commit())
+#define TIPA_PRETOK_TRIM 4096
+
+/// number of action events sent at once to the consumer thread, and
+/// number of batches that can wait in the queue (see
+/// parser_context::set_async_actions())
+#define TIPA_ACTION_BATCH 64
+#define TIPA_ACTION_QUEUE 16
+
+/// how often the time budget, the deadline and the cancellation flag
+/// are checked (see parser_context::set_budget())
+#define TIPA_BUDGET_CHECK_STEPS 1024
+
+/// default number of events kept by the tracer (see
+/// parser_context::set_trace())
+#define TIPA_TRACE_EVENTS 4096
 
 namespace tipa {
+    /**
+       The parsing engines. The recursive engine uses the C++ stack,
+       so very deep nesting in the input may overflow it. The
+       iterative engine keeps the state of the parser in a vector
+       allocated on the heap.
+    */
+    typedef enum {ENGINE_RECURSIVE, ENGINE_ITERATIVE} engine_t;
+
     /** 
         Helper functions to convert from a string to a variable of
-        type T
+        type T. They are based on std::from_chars(), so they do not
+        depend on the locale and do not throw: they return std::errc()
+        on success, and otherwise std::errc::invalid_argument or
+        std::errc::result_out_of_range, leaving the variable
+        unchanged. Numbers may start with a '+'; booleans are "true",
+        "false", "1" or "0". More types can be supported by
+        overloading convert_to() (such overloads may also take a
+        const std::string & and return void).
+    */
+    inline std::errc convert_to(std::string_view s, std::string &t) { t = s; return std::errc(); }
+
+    inline std::errc convert_to(std::string_view s, char &c)
+    {
+        if (s.size() != 1) return std::errc::invalid_argument;
+        c = s[0];
+        return std::errc();
+    }
+
+    inline std::errc convert_to(std::string_view s, bool &b)
+    {
+        if (s == "true" || s == "1") b = true;
+        else if (s == "false" || s == "0") b = false;
+        else return std::errc::invalid_argument;
+        return std::errc();
+    }
+
+    template<typename T>
+    std::enable_if_t<std::is_arithmetic_v<T> && !std::is_same_v<T, bool> && !std::is_same_v<T, char>, std::errc>
+    convert_to(std::string_view s, T &v)
+    {
+        const char *first = s.data();
+        const char *last = s.data() + s.size();
+        if (first != last && *first == '+') ++first;
+        if (first != last && (*first == '+' || *first == '-') && first != s.data())
+            return std::errc::invalid_argument;
+        T r;
+        auto res = std::from_chars(first, last, r);
+        if (res.ec != std::errc()) return res.ec;
+        if (res.ptr != last) return std::errc::invalid_argument;
+        v = r;
+        return std::errc();
+    }
+
+    /// A value produced by a rule (see parser_context::push_value())
+    typedef std::any sem_value;
+
+    /** 
+        A contiguous sequence of collected tokens (see
+        rule::set_span_action()). It is only valid during the action.
     */
-    inline void convert_to(const std::string &s, std::string& t) { t = s; }    
-    inline void convert_to(const std::string &s, int &i) { i = std::stoi(s); }
-    inline void convert_to(const std::string &s, float &f) { f = std::stof(s); }
-    inline void convert_to(const std::string &s, double &d) { d = std::stod(s); }
+    class token_span {
+        const token_val *first;
+        const token_val *last;
+    public:
+        token_span(const token_val *f, const token_val *l) : first(f), last(l) {}
+        const token_val *begin() const { return first; }
+        const token_val *end() const { return last; }
+        std::size_t size() const { return last - first; }
+        bool empty() const { return first == last; }
+        const token_val &operator[](std::size_t i) const { return first[i]; }
+    };
+
+    template<typename ...Args>
+    class inline_action;
+
+    /// forward declaration: implementation dependent
+    struct impl_rule;
+
+    typedef enum {
+        TRACE_ENTER,      // the rule starts parsing
+        TRACE_EXIT,       // the rule succeeded
+        TRACE_FAIL        // the rule failed
+    } trace_kind;
+
+    /// An event recorded by the tracer (see parser_context::set_trace())
+    struct trace_event {
+        /// the rule (the same for all the copies of a rule object)
+        const impl_rule *rule;
+        /// position of the parser (line, column)
+        std::int32_t line;
+        std::int32_t col;
+        std::uint32_t kind;     // a trace_kind
+        /// nesting of the rule
+        std::uint32_t depth;
+        /// nanoseconds since the parsing started
+        std::uint64_t time;
+    };
 
     /** 
      * It contains the lexer and the last token that has been read,
@@ -60,31 +192,354 @@ namespace tipa {
         // the collected tokens
         std::vector<token_val> collected;
 
-        std::stack<std::vector<token_val>> saved;
+        /* A saved context does not copy the collected tokens: the
+           first 'valid' tokens have not been touched since the
+           context was saved, and 'tail' contains the tokens that
+           have been removed since then (see drop_collected()). */
+        struct checkpoint {
+            std::size_t valid;
+            std::vector<token_val> tail;
+            // the same for the values
+            std::size_t vvalid;
+            std::vector<sem_value> vtail;
+            // the position in the token array (pretokenized mode)
+            std::size_t index;
+        };
+        std::vector<checkpoint> saved;
+        // the saved contexts below this depth have been committed
+        std::size_t cut_depth;
+
+        // removes the collected tokens from position n on
+        void drop_collected(std::size_t n);
+
+        // the values produced by the rules
+        std::vector<sem_value> values;
+        // removes the values from position n on
+        void drop_values(std::size_t n);
     
-        //token_val error_msg;
-        std::stack<error_message> error_stack;
+        // the errors are the first nerrors elements: the others are
+        // kept to reuse their memory
+        std::vector<error_message> error_stack;
+        std::size_t nerrors;
+
+        // when false, rule actions are not invoked
+        bool actions_on;
+
+        // the parsing cannot continue (see is_halted())
+        bool halted;
+
+        engine_t engine;
+        // current and maximum nesting of rules (0 = no limit)
+        std::size_t depth;
+        std::size_t max_depth;
+        bool depth_exceeded();
+
+        // number of rules invoked since set_stream(), and the budget
+        // (see set_budget())
+        std::size_t steps;
+        std::size_t step_limit;
+        std::chrono::steady_clock::duration time_limit;
+        std::chrono::steady_clock::time_point started;
+        // absolute deadline (max() if none) and cancellation flag
+        // (see set_deadline() and set_cancel_flag())
+        std::chrono::steady_clock::time_point deadline;
+        const std::atomic<bool> *cancel_flag;
+        // steps at which the budget is checked again
+        std::size_t next_check;
+        bool check_budget();
+        void reset_budget();
+
+        /* Pretokenized mode (see pretokenize()): the input has been
+           split once into an array of records, and the position is
+           an index in the array. The text of the records is not
+           copied, it is a range of src. */
+        struct token_rec {
+            token_id id;
+            std::uint32_t offset;
+            std::uint32_t len;
+            std::uint32_t line;     // index in src_lines
+            std::uint32_t col;
+        };
+        struct source_line {
+            std::size_t offset;
+            std::size_t len;
+            int nline;
+        };
+        // a line of the input and its tokens (offsets from the
+        // beginning of the line)
+        struct token_line {
+            std::string text;
+            int nline;
+            std::vector<token_rec> recs;
+        };
+        // the lexer thread of the pipelined mode
+        struct token_pipe;
+
+        bool pretok;
+        // in pipelined mode, the array is filled lazily (see
+        // fetch_tokens()); record tok_index, if it exists, has always
+        // been fetched, so that get_pos() does not wait
+        std::vector<token_rec> tok_recs;
+        // the ids of the tokens that split the input (sorted), also as
+        // a bitmap from tok_id_base when they are not too far apart
+        std::vector<token_id> tok_ids;
+        std::vector<bool> tok_split;
+        token_id tok_id_base;
+        bool splits_input(token_id id) const;
+        std::vector<source_line> src_lines;
+        std::string src;
+        std::size_t tok_index;
+        bool tok_eof_hit;
+        std::pair<int, int> tok_end;
+        std::exception_ptr tok_error;
+        std::unique_ptr<token_pipe> pipe;
+
+        bool lex_line(const std::vector<token> &tokens, token_line &l);
+        void append_line(const token_line &l);
+        // true if record i exists, waiting for the lexer thread; at
+        // the end, throws the exception of the lexer
+        bool tok_ready(std::size_t i);
+        bool fetch_tokens(std::size_t i);
+        void drop_tokens();
+        void stop_pipe();
+
+        token_val match_record(const token &tk, const std::function<void(std::string_view)> &fun);
+        void no_pretok(const char *fn) const;
+
+        // the consumer thread of the asynchronous actions
+        struct action_queue;
+        std::unique_ptr<action_queue> async;
+        void flush_actions();
+        void stop_actions();
+
+        // the tracer (see set_trace()): a ring of events, of which
+        // trace_count have been recorded since the parsing started
+        bool trace_on;
+        std::vector<trace_event> trace_buf;
+        std::size_t trace_count;
+        std::ostream *trace_dump;
+        void record_trace(const impl_rule *r, trace_kind k);
         
     public:
         parser_context(); 
+        ~parser_context();
 
+        /// starts parsing a new input (see reset())
         void set_stream(std::istream &in);
+        /// Starts parsing the string s, read directly from the
+        /// caller's memory (without a stream): s must not change
+        /// until the parsing is over
+        void set_input(std::string_view s);
+        /** Forgets the input and the state of the parsing (tokens,
+         * values, saved contexts, errors, steps), but keeps the
+         * configuration (engine, comments, streaming, limits, ...)
+         * and the memory already allocated, so that parsing many
+         * small inputs with the same context does not allocate
+         * again. set_stream() must be called before parsing.
+         */
+        void reset();
+        /// see lexer::set_streaming(); restoring a context whose
+        /// line has been released stops the parser with an
+        /// ERR_PARSE_LOOKBACK error
+        void set_streaming(bool flag, std::size_t max_lines = 0);
         void set_comment(const std::string &comment_begin, 
                          const std::string &comment_end,
                          const std::string &comment_single_line);
 
         token_val        try_token(const token &tk);
+        /// see lexer::try_token()
+        token_val        try_token(const token &tk, const std::function<void(std::string_view)> &fun);
         std::string      extract(const std::string &op, const std::string &cl);
         std::string      extract_line();
 
+        /**
+           Pretokenized mode: reads all the input (which must have
+           been set with set_stream() or set_input()) and splits it
+           into tokens, trying the tokens of the list in order (as the
+           ahead_lexer). A character that does not match any token
+           becomes a token of one character.
+
+           Then, the rules work on the array of tokens: a terminal
+           whose token is in the list only compares the token ids,
+           while any other terminal (e.g. rule('+'), or rule("==")
+           that spans two tokens) is matched on the text of one or
+           more consecutive tokens. In both cases, a token is never
+           split. Backtracking only moves an index in the array, so
+           the input is lexed only once. The tokens before a cut are
+           dropped from the array (see commit()), together with their
+           text; the text still in the array must stay below 4 GiB.
+
+           The rules that work on the raw text (extract_rule(),
+           extract_line_rule(), number_list_rule()) cannot be used
+           in this mode.
+
+           If pipelined is true, the input is split by another
+           thread, while the rules are parsing: the lexer thread
+           sends the tokens of each line through a lock-free queue
+           (see spsc_queue), and the parser appends them to the
+           array when it needs them, so reading and lexing overlap
+           with parsing. The tokens received are kept in the array,
+           so backtracking works as before. Each thread sleeps while
+           the queue is full (or empty). An exception of the
+           lexer is thrown by the rule that reaches that point of the
+           input. The context must not be configured (comments,
+           streaming, ...) until the parsing is over.
+         */
+        void pretokenize(const std::vector<token> &tokens, bool pipelined = false);
+        bool is_pretokenized() const { return pretok; }
+        /// number of tokens in the array (pretokenized mode; in
+        /// pipelined mode, the tokens received so far, and in both
+        /// modes, without the ones dropped by commit())
+        std::size_t token_count() const { return tok_recs.size(); }
+
         void save();
         void restore();
         void discard_saved();
+        /// number of contexts currently saved
+        std::size_t saved_depth() const { return saved.size(); }
+
+        /// Commits the parsing done so far: all contexts saved until
+        /// now are discarded (see the cut() rule). In pretokenized
+        /// mode, the tokens before the current one are dropped, once
+        /// they are at least TIPA_PRETOK_TRIM and half of the array
+        void commit();
+
+        /// Selects the parsing engine (the recursive one by default)
+        void set_engine(engine_t e) { engine = e; }
+        engine_t get_engine() const { return engine; }
+
+        /// Sets the maximum nesting of rules during parsing (0 means
+        /// no limit, the default). When the limit is exceeded, the
+        /// parsing stops with an ERR_PARSE_DEPTH error. 
+        void set_max_depth(std::size_t d) { max_depth = d; }
+
+        /// Limits the work of the parser, so that a hostile input (or
+        /// a grammar that backtracks exponentially) cannot keep it
+        /// busy: at most max_steps rules are invoked, and the parsing
+        /// lasts at most max_time (0 means no limit, the default for
+        /// both). Beyond that, the parsing stops with an
+        /// ERR_PARSE_BUDGET error. The budget starts again at each
+        /// set_stream(); the time is checked every
+        /// TIPA_BUDGET_CHECK_STEPS steps.
+        void set_budget(std::size_t max_steps, 
+                        std::chrono::milliseconds max_time = std::chrono::milliseconds(0));
+        /// number of rules invoked since set_stream()
+        std::size_t get_steps() const { return steps; }
+
+        /// Stops the parsing at time t, with an ERR_PARSE_BUDGET
+        /// error (time_point::max() removes the deadline). Unlike
+        /// the time budget, the deadline is not moved by
+        /// set_stream(), so it can cover the whole request.
+        void set_deadline(std::chrono::steady_clock::time_point t);
+
+        /** Stops the parsing as soon as *flag becomes true (nullptr
+         * removes the flag). The flag can be set from any other
+         * thread; it is checked every TIPA_BUDGET_CHECK_STEPS
+         * steps. The parsing then stops with an ERR_PARSE_CANCELLED
+         * error, whose position is the one reached by the parser:
+         * all rules fail, restoring the context, so the same
+         * parser_context can be used again after set_stream().
+         */
+        void set_cancel_flag(const std::atomic<bool> *flag);
+
+        /// (internal) invoked when a rule starts and ends parsing
+        bool enter_rule() {
+            if (++steps >= next_check && !check_budget()) return false;
+            if (++depth > max_depth && max_depth != 0) return depth_exceeded();
+            return true;
+        }
+        void exit_rule() { --depth; }
+
+        /**
+           Records the rules invoked by the parser, for debugging a
+           grammar on real inputs: each rule adds an event (the rule,
+           the position, enter/exit/fail, the time) to a ring of
+           nevents events, so that the last ones are kept at a fixed
+           cost. nevents = 0 disables the tracer (the default); when
+           it is disabled, a rule only tests a flag. The events are
+           recorded again from each set_stream().
+
+           If on_failure is not null, parse_all() writes the events
+           on it (see dump_trace()) when the parsing fails.
+         */
+        void set_trace(std::size_t nevents = TIPA_TRACE_EVENTS, std::ostream *on_failure = nullptr);
+        bool tracing() const { return trace_on; }
+
+        /// (internal) invoked by each rule
+        void trace(const impl_rule *r, trace_kind k) {
+            if (trace_on) record_trace(r, k);
+        }
+
+        /// the events kept by the tracer, from the oldest one
+        std::vector<trace_event> get_trace() const;
+        /// number of events recorded since the parsing started
+        /// (including those dropped from the ring)
+        std::size_t trace_events() const { return trace_count; }
+        /// writes the events kept by the tracer, one per line,
+        /// indented by depth. The rules are printed, so they must
+        /// still exist.
+        void dump_trace(std::ostream &os) const;
+        /// (internal) dumps the events on the stream given to
+        /// set_trace(), if any
+        void trace_failure() const;
+
+        /// number of input lines kept in memory by the lexer
+        std::size_t retained_lines() const { return lex.retained_lines(); }
+
+        /// see lexer::cached_attempts()
+        std::size_t cached_attempts() const { return lex.cached_attempts(); }
+
+        /// true when the parsing cannot succeed anymore (for example,
+        /// when a rule failed after a cut): all rules fail without
+        /// trying alternatives
+        bool is_halted() const { return halted; }
+
+        /// Enables/disables the invocation of actions (enabled by
+        /// default). Useful for trying a rule without side effects.
+        void enable_actions(bool f) { actions_on = f; }
+        bool actions_enabled() const { return actions_on; }
+
+        /**
+           Runs the asynchronous actions (see
+           rule::set_async_action()) on another thread. Each time
+           such an action is invoked, an event (the action and a copy
+           of the tokens of its rule) is sent to the consumer thread
+           through a lock-free queue (see spsc_queue), in batches of
+           TIPA_ACTION_BATCH events, and the parser goes on. The
+           consumer thread runs the events in the order in which
+           they were sent, that is the order in which the actions
+           would run with async disabled (the default), including
+           the actions of the alternatives that fail later.
+
+           The actions run concurrently with the parser, so they
+           must not share data with the other actions, and the rules
+           must stay alive until wait_actions() returns. Disabling
+           async waits for the pending actions.
+         */
+        void set_async_actions(bool flag);
+        bool async_actions() const { return bool(async); }
+
+        /// Waits until all the actions sent so far have run. If an
+        /// action threw an exception, the following actions are not
+        /// run, and the exception is thrown again here. parse_all()
+        /// calls it at the end of the parsing.
+        void wait_actions();
+
+        /// (internal) runs f on s, or sends it to the consumer thread
+        void post_action(const inline_action<token_span> &f, token_span s);
+
+        /// true if the lexer has been asked for a token past the end
+        /// of the input (see lexer::eof_reached())
+        bool eof_reached() const { return pretok ? tok_eof_hit : lex.eof_reached(); }
+        void clear_eof_reached() { tok_eof_hit = false; if (!pretok) lex.clear_eof_reached(); }
 
         /// reads the last token
         token_val get_last_token();
 
-        void set_error(const token_val &tk, const std::string &err_msg);
+        void set_error(const token_val &tk, std::string_view err_msg);
+        /// the text s of a token could not be converted to a value:
+        /// sets an ERR_PARSE_CONV error and halts the parser
+        void conversion_error(const std::string &s);
         void empty_error_stack(); 
         error_message get_last_error() const;
         
@@ -92,11 +547,30 @@ namespace tipa {
         std::string get_formatted_err_msg();
         bool eof();
 
+        /// returns the current position (line num, column num)
+        std::pair<int, int> get_pos() const;
+
+        /// see lexer::peek_line() and lexer::consume()
+        std::string_view peek_line() { no_pretok("peek_line"); return lex.peek_line(); }
+        void consume(std::size_t n) { no_pretok("consume"); lex.consume(n); }
+
         void push_token(token_val tk);
         void push_token(const std::string &s);
 
         std::string read_token();
 
+        /// number of tokens collected so far
+        std::size_t collected_count() const { return collected.size(); }
+
+        /// the tokens collected from position n on
+        token_span collected_since(std::size_t n) const {
+            return token_span(collected.data() + std::min(n, collected.size()),
+                              collected.data() + collected.size());
+        }
+
+        /// removes the tokens collected from position n on
+        void drop_tokens(std::size_t n) { drop_collected(n); }
+
         /// returns all tokens collected so far
         std::vector<token_val> collect_tokens();
 
@@ -114,46 +588,282 @@ namespace tipa {
             
             auto p = begin(collected) + s - n;
             for(auto q = p; q != end(collected); q++) *(it++) = fun(*q);
-            collected.erase(p, collected.end());
+            drop_collected(s - n);
         }
 
         template<typename It, typename F=std::function<std::string(token_val)>>
         void collect_tokens(It it, F fun=[](token_val tv) { return tv.second; }) {
             auto p = begin(collected);
             for (auto q = p; q != end(collected); q++) *(it++) = fun(*q);
-            collected.erase(p, collected.end());
+            drop_collected(0);
+        }
+
+        /**
+           The typed values. Terminal rules can convert their token
+           to a value (see rule::as()), and the actions of the other
+           rules can pop the values of their children and push a new
+           one (see also combine()). Like the collected tokens, the
+           values are restored when the parser backtracks.
+        */
+        template<typename T>
+        void push_value(T &&v) { values.emplace_back(std::forward<T>(v)); }
+
+        /// number of values currently on the stack
+        std::size_t value_count() const { return values.size(); }
+
+        /// returns the k-th value from the top of the stack (0 is the
+        /// last one pushed), which must be of type T
+        template<typename T>
+        const T &peek_value(std::size_t k = 0) const {
+            if (k >= values.size()) throw parse_exc("peek_value(): too few values");
+            auto p = std::any_cast<T>(&values[values.size() - 1 - k]);
+            if (!p) throw parse_exc("peek_value(): the value has a different type");
+            return *p;
+        }
+
+        /// removes all the values, and returns them in the order in
+        /// which they were pushed
+        std::vector<sem_value> take_values();
+
+        /// removes the last n values
+        void pop_values(std::size_t n) {
+            if (n > values.size()) throw parse_exc("pop_values(): too few values");
+            drop_values(values.size() - n);
+        }
+
+        /// removes the last value, which must be of type T, and returns it
+        template<typename T>
+        T pop_value() {
+            T v = peek_value<T>();
+            pop_values(1);
+            return v;
         }
     };
 
+    /**
+       A pool of parser contexts, to parse many inputs without
+       creating a context for each one. A context is taken from the
+       pool with acquire(), and it goes back to the pool (after a
+       reset()) when the handle is destroyed:
+
+       \code
+       auto pc = context_pool::local().acquire();
+       pc->set_stream(str);
+       parse_all(r, *pc);
+       \endcode
+
+       A context keeps its configuration from one use to the next
+       (engine, comments, streaming, maximum depth, budget, async
+       actions), so the contexts of a pool should be used for the
+       same kind of input. The settings of a single request are
+       cleared when the context goes back to the pool: the deadline,
+       the cancellation flag and the tracer, which point to objects
+       of the previous user. The pool is not thread-safe: local()
+       returns a pool for each thread, and a handle must be destroyed
+       in the thread that acquired it.
+     */
+    class context_pool {
+    public:
+        struct releaser {
+            context_pool *pool;
+            void operator()(parser_context *pc) const;
+        };
+        typedef std::unique_ptr<parser_context, releaser> handle;
+
+        /// at most max_free contexts are kept in the pool
+        explicit context_pool(std::size_t max_free = 8) : max_free(max_free) {}
+
+        /// a context from the pool, or a new one if the pool is empty
+        handle acquire();
+        /// number of contexts in the pool
+        std::size_t size() const { return free_list.size(); }
+
+        /// the pool of the calling thread
+        static context_pool &local();
+    private:
+        std::vector<std::unique_ptr<parser_context>> free_list;
+        std::size_t max_free;
+    };
+
 
     /* helper functions with common actions */
 
     /**
-       Reads a token and updates a variable 
+       Reads a token and updates a variable. If the token cannot be
+       converted, the parser context gets an ERR_PARSE_CONV error
+       (see parser_context::conversion_error()) and false is
+       returned.
      */
     template<typename T>
-    void read_all(parser_context &pc, T&& var)
+    bool read_all(parser_context &pc, T&& var)
     {
-        convert_to(pc.read_token(), std::forward<T&>(var));
+        std::string s = pc.read_token();
+        if constexpr (std::is_void_v<decltype(convert_to(s, var))>) {
+            convert_to(s, var);
+            return true;
+        }
+        else {
+            if (convert_to(s, var) == std::errc()) return true;
+            pc.conversion_error(s);
+            return false;
+        }
     }
     
     /**
        Reads a sequence of N tokens to update N variables
      */
     template<typename T, typename ...Args>
-    void read_all(parser_context &pc, T&& var, Args&&...args)
+    bool read_all(parser_context &pc, T&& var, Args&&...args)
     {
-        read_all(pc, std::forward<Args&>(args)...);
-        read_all(pc, std::forward<T&>(var));
+        bool f = read_all(pc, std::forward<Args&>(args)...);
+        return read_all(pc, std::forward<T&>(var)) && f;
     }
     
 
-    /// forward declaration: implementation dependent
-    struct impl_rule;
-
     /// The action function which is passed the parser context
     typedef std::function< void(parser_context &)> action_t;
 
+    /**
+       A function stored inline. Any callable with signature
+       void(Args...) can be converted to an inline_action (a lambda,
+       a std::bind() object, a function pointer, a std::function...).
+       Unlike std::function, callables of up to buffer_size bytes
+       (for example, a lambda capturing up to four references) are
+       stored without allocating memory, and invoking them costs a
+       single call through a function pointer. Larger callables are
+       allocated on the heap.
+    */
+    template<typename ...Args>
+    class inline_action {
+    public:
+        static constexpr std::size_t buffer_size = 4 * sizeof(void *);
+    private:
+        typedef enum {ACT_COPY, ACT_MOVE, ACT_DESTROY} op_t;
+        typedef void (*invoke_t)(void *, Args...);
+        typedef void (*manage_t)(op_t, void *, void *);
+
+        alignas(std::max_align_t) unsigned char buf[buffer_size];
+        invoke_t invoke_p;
+        manage_t manage_p;
+
+        template<typename F>
+        struct ops {
+            static constexpr bool local = sizeof(F) <= buffer_size &&
+                alignof(F) <= alignof(std::max_align_t) &&
+                std::is_nothrow_move_constructible_v<F>;
+
+            static F *get(void *b) {
+                if constexpr (local) return std::launder(reinterpret_cast<F *>(b));
+                else return *reinterpret_cast<F **>(b);
+            }
+            static void invoke(void *b, Args... args) { (*get(b))(std::forward<Args>(args)...); }
+            static void manage(op_t op, void *dst, void *src) {
+                switch (op) {
+                case ACT_COPY:
+                    if constexpr (local) new (dst) F(*get(src));
+                    else *reinterpret_cast<F **>(dst) = new F(*get(src));
+                    break;
+                case ACT_MOVE:
+                    if constexpr (local) {
+                        new (dst) F(std::move(*get(src)));
+                        get(src)->~F();
+                    }
+                    else *reinterpret_cast<F **>(dst) = get(src);
+                    break;
+                case ACT_DESTROY:
+                    if constexpr (local) get(dst)->~F();
+                    else delete get(dst);
+                    break;
+                }
+            }
+        };
+
+        void reset() {
+            if (manage_p) manage_p(ACT_DESTROY, buf, nullptr);
+            invoke_p = nullptr;
+            manage_p = nullptr;
+        }
+    public:
+        inline_action() : invoke_p(nullptr), manage_p(nullptr) {}
+        inline_action(std::nullptr_t) : inline_action() {}
+
+        template<typename F, typename D = std::decay_t<F>,
+                 typename = std::enable_if_t<!std::is_same_v<D, inline_action> &&
+                                             std::is_invocable_v<D &, Args...>>>
+        inline_action(F &&f) : inline_action() {
+            // an empty std::function or a null function pointer
+            if constexpr (!std::is_function_v<std::remove_reference_t<F>> &&
+                          (std::is_pointer_v<D> || std::is_same_v<D, std::function<void(Args...)>>))
+                if (!f) return;
+            if constexpr (ops<D>::local) new (buf) D(std::forward<F>(f));
+            else *reinterpret_cast<D **>(buf) = new D(std::forward<F>(f));
+            invoke_p = &ops<D>::invoke;
+            manage_p = &ops<D>::manage;
+        }
+
+        inline_action(const inline_action &other) : invoke_p(other.invoke_p), manage_p(other.manage_p) {
+            if (manage_p) manage_p(ACT_COPY, buf, const_cast<unsigned char *>(other.buf));
+        }
+        inline_action(inline_action &&other) noexcept : invoke_p(other.invoke_p), manage_p(other.manage_p) {
+            if (manage_p) manage_p(ACT_MOVE, buf, other.buf);
+            other.invoke_p = nullptr;
+            other.manage_p = nullptr;
+        }
+        inline_action &operator=(inline_action other) {
+            reset();
+            invoke_p = other.invoke_p;
+            manage_p = other.manage_p;
+            if (manage_p) manage_p(ACT_MOVE, buf, other.buf);
+            other.invoke_p = nullptr;
+            other.manage_p = nullptr;
+            return *this;
+        }
+        ~inline_action() { reset(); }
+
+        explicit operator bool() const { return invoke_p != nullptr; }
+        // as std::function, the callable may change its state
+        void operator()(Args... args) const {
+            invoke_p(const_cast<unsigned char *>(buf), std::forward<Args>(args)...);
+        }
+    };
+
+    /// The action stored in a rule (see rule::set_action())
+    typedef inline_action<parser_context &> action_fn;
+
+    /// An action which receives the tokens collected by its rule
+    typedef inline_action<parser_context &, token_span> span_action_fn;
+
+    /// An action which only receives the tokens collected by its
+    /// rule, and can run on another thread (see rule::set_async_action())
+    typedef inline_action<token_span> async_action_fn;
+
+    /// Converts the text of a token to a value on the parser context
+    /// (returns false if the conversion fails)
+    typedef bool (*value_conv_t)(parser_context &, std::string_view);
+
+    template<typename R, typename ...Args, typename F, std::size_t ...I>
+    R apply_values(parser_context &pc, F &f, std::index_sequence<I...>)
+    {
+        return f(pc.peek_value<Args>(sizeof...(Args) - 1 - I)...);
+    }
+
+    /**
+       Builds an action that pops the values of types Args (pushed
+       in this order by the children of the rule) and pushes the
+       value of type R returned by f(args...). For example: 
+
+       sum.set_action(combine<int, int, int>([](int a, int b) { return a + b; }));
+    */
+    template<typename R, typename ...Args, typename F>
+    action_fn combine(F f)
+    {
+        return [f](parser_context &pc) mutable {
+            R r = apply_values<R, Args...>(pc, f, std::index_sequence_for<Args...>{});
+            pc.pop_values(sizeof...(Args));
+            pc.push_value(std::move(r));
+        };
+    }
+
     /** The concrete rule class */
     class rule {
         /// Implementation 
@@ -182,7 +892,21 @@ namespace tipa {
         rule &operator=(const rule &);
     
         /// Sets an action for this rule
-        rule& set_action(action_t af);
+        rule& set_action(action_fn af);
+
+        /// Sets an action that receives at once all the tokens
+        /// collected while parsing this rule (for example, all the
+        /// elements of a list), which are then removed from the
+        /// parser context. It replaces the action set by
+        /// set_action(), if any.
+        rule& set_span_action(span_action_fn af);
+
+        /// Like set_span_action(), but the action does not access
+        /// the parser context, so it can run on the consumer thread
+        /// of the context (see parser_context::set_async_actions()).
+        /// There, the span is a copy of the tokens, valid during the
+        /// action.
+        rule& set_async_action(async_action_fn af);
                 
         /// Installs a special action that reads a sequence of variables
         template<typename ...Args>
@@ -191,6 +915,25 @@ namespace tipa {
             return *this;
         }
 
+        /// The token matched by this terminal rule is converted to a
+        /// value of type T and pushed on the value stack of the
+        /// parser context (see parser_context::push_value()), instead
+        /// of being collected. The text of the token is not copied.
+        template<typename T>
+        rule & as() {
+            return set_value_conv([](parser_context &pc, std::string_view s) {
+                    T v;
+                    if (convert_to(s, v) != std::errc()) {
+                        pc.conversion_error(std::string(s));
+                        return false;
+                    }
+                    pc.push_value(std::move(v));
+                    return true;
+                });
+        }
+        /// (see as()) throws a parse_exc if this is not a terminal rule
+        rule & set_value_conv(value_conv_t conv);
+
         /// Parses a rule
         bool parse(parser_context &pc) const;
 
@@ -226,14 +969,97 @@ namespace tipa {
     rule operator*(rule &a);
     rule operator*(rule &&a);
 
+    /** Repetition of rules, one or more times */
+    rule operator+(rule &a);
+    rule operator+(rule &&a);
+
+    /** Repetition of rules, at least min and at most max times
+     * (throws a parse_exc if min is greater than max) */
+    rule repeat_rule(rule &a, unsigned min, unsigned max = REP_UNLIMITED);
+    rule repeat_rule(rule &&a, unsigned min, unsigned max = REP_UNLIMITED);
+
     /** Optional rule: this is a shortcut for the alternation of an
      * empty rule and the rule a */
     rule operator-(rule &a);
     rule operator-(rule &&a);
 
-    /** creates a rule that parses a list of elements */
+    /** The cut: a rule that matches the empty string, and commits
+     * the parsing done so far. After a cut, the parser cannot
+     * backtrack: if a rule fails, the whole parsing fails. In
+     * exchange, the lexer and the parser context release the memory
+     * used for backtracking, so a long input can be parsed in
+     * constant memory, for example with *(item >> cut()).
+     * Like actions, cuts are ignored when actions are disabled. */
+    rule cut();
+
+    /** creates a rule that parses a list of elements. The rule is
+     * recursive (the action, if any, is invoked once per element,
+     * from the last one to the first one), so very long lists may
+     * exhaust the stack.
+     * \deprecated kept for the grammars that rely on the order of
+     * its actions: new code should use sep_list_rule() */
     rule list_rule(rule &&r, const std::string &sep = ",");
 
+    /** creates a rule that parses a list of at least min elements
+     * separated by sep. The list is parsed by a loop, so its length
+     * is not limited by the stack, and the action (if any) is
+     * invoked once for the whole list. */
+    rule sep_list_rule(rule &r, const std::string &sep = ",", unsigned min = 1);
+    rule sep_list_rule(rule &&r, const std::string &sep = ",", unsigned min = 1);
+
+    /** creates a rule that parses a list of at least min numbers
+     * separated by the character sep, possibly on several lines (as
+     * sep_list_rule(rule(tk_int), sep, min), but negative numbers
+     * are accepted for signed types). The numbers are appended to
+     * out, which is typically reserved in advance by the caller.
+     * The list is scanned directly on the input lines, without going
+     * through the tokens and the actions of the general rules (the
+     * digits of integers are converted 8 at a time). As with
+     * actions, the numbers are not removed from out if the parser
+     * backtracks after the list. A number out of the range of T
+     * halts the parser with an ERR_PARSE_CONV error.
+     * T can be any integral type (except bool and char), float or
+     * double; a floating point number starts with a digit or a dot
+     * (inf and nan are not numbers). */
+    template<typename T>
+    rule number_list_rule(std::vector<T> &out, char sep = ',', unsigned min = 1);
+
+    /** Associativity of the operators in an operator table (see
+     * operator_table_rule()) */
+    typedef enum {OP_LEFT, OP_RIGHT, OP_PREFIX} op_assoc;
+
+    /** An operator in an operator table: its symbol, associativity
+     * and precedence (a higher precedence binds tighter), and the
+     * action invoked after the operator and its operands have been
+     * parsed. */
+    struct op_entry {
+        std::string sym;
+        op_assoc assoc;
+        int prec;
+        action_fn action;
+
+        op_entry(char c, op_assoc a, int p, action_fn f = nullptr) :
+            sym(1, c), assoc(a), prec(p), action(std::move(f)) {}
+        op_entry(const std::string &s, op_assoc a, int p, action_fn f = nullptr) :
+            sym(s), assoc(a), prec(p), action(std::move(f)) {}
+    };
+
+    /** creates a rule that parses expressions made of operands
+     * (matched by the primary rule) and of the operators in the
+     * table, for example:
+     *
+     * operator_table_rule(primary, {{'+', OP_LEFT, 10, add}, 
+     *                               {'*', OP_LEFT, 20, mul},
+     *                               {'-', OP_PREFIX, 30, neg}});
+     *
+     * The action of an operator is invoked after the actions of its
+     * operands, so the actions can build the expression tree with a
+     * stack, as with the equivalent layered grammar. However, each
+     * operand is parsed only once, whatever the number of precedence
+     * levels. */
+    rule operator_table_rule(rule &primary, const std::vector<op_entry> &ops);
+    rule operator_table_rule(rule &&primary, const std::vector<op_entry> &ops);
+
     /** Extracts (collects) part of the text. The first parameter
      * represents the string which marks the start of the text
      * sequence, whereas the second parameters represents the closing
@@ -254,8 +1080,74 @@ namespace tipa {
     /** Matches a given keyword. By default, the keyword is collected. */
     rule keyword(const std::string &key, bool collect = true);
 
+    /** Matches any keyword of the list. The identifier is read once
+     * and looked up in a table (with a perfect hash built when the
+     * rule is created), so this is faster than an alternation of
+     * keyword() rules. By default, the keyword is collected. */
+    rule keywords(const std::vector<std::string> &keys, bool collect = true);
+
+    /** A keyword and the rule that follows it (see keyword_switch()).
+     * As for the operators, the rule is only referenced if it is an
+     * lvalue, and it is owned if it is a temporary. */
+    struct keyword_case {
+        std::string key;
+        rule r;
+        bool owned;
+
+        keyword_case(const std::string &k, rule &x) : key(k), r(x), owned(false) {}
+        keyword_case(const std::string &k, rule &&x) : key(k), r(std::move(x)), owned(true) {}
+    };
+
+    /** Reads a keyword of the list, then parses the rule associated to
+     * it, for example:
+     *
+     * keyword_switch({{"global", global_body}, {"exec", exec_body}});
+     *
+     * is equivalent to (keyword("global") >> global_body) |
+     * (keyword("exec") >> exec_body), but the identifier is read and
+     * looked up only once. */
+    rule keyword_switch(const std::vector<keyword_case> &cases, bool collect = true);
+
+    /** Grammar optimization: in all the alternations reachable from
+     * root, consecutive alternatives that start with the same rules
+     * (the same rule object, or equal terminals) are rewritten so
+     * that the common prefix is parsed only once:
+     *
+     * (a >> b >> c) | (a >> b >> d)   becomes   a >> b >> (c | d)
+     *
+     * The parsed inputs, the collected tokens and the order of the
+     * actions do not change: a prefix is factored only if it has no
+     * actions and no cuts, and an alternative with an action is
+     * never split. The grammar must be complete (and not in use by
+     * a parser). Returns a description of each rewriting. */
+    std::vector<std::string> left_factor(rule &root);
+
+    /** The number of distinct rules reachable from root (including
+     * root). Identical terminals, and identical rules made of
+     * temporaries, are created only once when they are passed to
+     * the operators (they are shared), so they are counted once. */
+    std::size_t count_nodes(rule &root);
+
+    /** Checks the grammar reachable from root, and returns a
+     * description of each problem found:
+     *
+     * - a repetition (or a list) of a rule that can succeed without
+     *   consuming input: the repetition stops after such an
+     *   instance, which is probably not what was intended;
+     *
+     * - left recursion: a rule that can invoke itself without
+     *   consuming input, which never terminates (until the maximum
+     *   depth or the budget is exceeded, see parser_context).
+     */
+    std::vector<std::string> check_grammar(rule &root);
+
     /** the global parsing function */
     bool parse_all(const rule &r, parser_context &pc);
+
+    /** Parses all the string s with a context of the calling thread
+     * that has the default configuration and is reused from one call
+     * to the next, which is convenient for small inputs. */
+    bool parse_all(const rule &r, std::string_view s);
 }
 
 #endif
@@ -110,3 +110,105 @@ TEST_CASE("read_vars(): more complex patterns", "[action]")
     REQUIRE(p2 == 12);
     REQUIRE(p3 == 23);    
 }
+
+static int counter = 0;
+static void count_action(parser_context &) { counter++; }
+
+TEST_CASE("actions of any kind of callable", "[action]")
+{
+    rule r = rule(tk_int);
+    stringstream str("1 2 3 4");
+    parser_context pc;
+    pc.set_stream(str);
+
+    // a function pointer
+    r.set_action(count_action);
+    REQUIRE(r.parse(pc));
+    REQUIRE(counter == 1);
+
+    // a lambda too large to be stored inline
+    char big[2 * action_fn::buffer_size] = "x";
+    r.set_action([big](parser_context &) { counter += big[0]; });
+    REQUIRE(r.parse(pc));
+    REQUIRE(counter == 1 + 'x');
+
+    // copying an action copies the callable with its state
+    int calls = 0;
+    action_fn a = [calls, &counter = counter](parser_context &) mutable { counter = ++calls; };
+    action_fn b = a;
+    b(pc);
+    b(pc);
+    a(pc);
+    REQUIRE(counter == 1);
+
+    // an empty action_t is no action
+    r.set_action(action_t());
+    REQUIRE(r.parse(pc));
+    REQUIRE(counter == 1);
+    REQUIRE(!action_fn(action_t()));
+    REQUIRE(!action_fn(static_cast<void (*)(parser_context &)>(nullptr)));
+}
+
+TEST_CASE("convert_to() on all the arithmetic types", "[action]")
+{
+    long l; unsigned long long u; int16_t s; bool b; float f; double d; char c;
+    REQUIRE(convert_to("-9000000000", l) == errc());
+    REQUIRE(l == -9000000000L);
+    REQUIRE(convert_to("18446744073709551615", u) == errc());
+    REQUIRE(u == 18446744073709551615ULL);
+    REQUIRE(convert_to("+12", s) == errc());
+    REQUIRE(s == 12);
+    REQUIRE(convert_to("true", b) == errc());
+    REQUIRE(b);
+    REQUIRE(convert_to("0", b) == errc());
+    REQUIRE(!b);
+    REQUIRE(convert_to("2.5", f) == errc());
+    REQUIRE(f == 2.5f);
+    REQUIRE(convert_to("1e-3", d) == errc());
+    REQUIRE(d == 1e-3);
+    REQUIRE(convert_to("x", c) == errc());
+    REQUIRE(c == 'x');
+
+    s = 7;
+    REQUIRE(convert_to("40000", s) == errc::result_out_of_range);
+    REQUIRE(convert_to("12a", s) == errc::invalid_argument);
+    REQUIRE(convert_to("", s) == errc::invalid_argument);
+    REQUIRE(convert_to("+-1", s) == errc::invalid_argument);
+    REQUIRE(convert_to("-1", u) == errc::invalid_argument);
+    REQUIRE(convert_to("yes", b) == errc::invalid_argument);
+    REQUIRE(s == 7);
+}
+
+TEST_CASE("read_vars() reports conversion errors", "[action]")
+{
+    uint8_t small;
+    long big;
+    rule r = rule(tk_int) >> rule(tk_int);
+    r.read_vars(big, small);
+
+    stringstream str("12345678901 300");
+    parser_context pc;
+    pc.set_stream(str);
+    REQUIRE(!parse_all(r, pc));
+    REQUIRE(pc.get_last_error().token.first == ERR_PARSE_CONV);
+    REQUIRE(pc.get_last_error().token.second == "300");
+    REQUIRE(big == 12345678901L);
+}
+
+TEST_CASE("a conversion error inside an alternation is reported", "[action]")
+{
+    uint8_t small = 0;
+    rule num = rule(tk_int);
+    num.read_vars(small);
+    rule r = *(num | rule(tk_ident));
+
+    for (auto engine : {ENGINE_RECURSIVE, ENGINE_ITERATIVE}) {
+        stringstream str("300 abc 5 def");
+        parser_context pc;
+        pc.set_stream(str);
+        pc.set_engine(engine);
+        REQUIRE(!parse_all(r, pc));
+        REQUIRE(pc.get_last_error().token.first == ERR_PARSE_CONV);
+        REQUIRE(pc.get_last_error().token.second == "300");
+    }
+}
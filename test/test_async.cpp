@@ -0,0 +1,186 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+  
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <chrono>
+#include <ctime>
+
+#include <tinyparser.hpp>
+
+using namespace std;
+using namespace tipa;
+
+/* A grammar whose actions record the order in which they are
+   invoked, including those of an alternative that fails. */
+struct trace_grammar {
+    vector<string> trace;
+    rule pair_r, first, second, item, root;
+
+    trace_grammar() {
+        pair_r = rule(tk_ident) >> rule('=') >> rule(tk_int);
+        pair_r.set_async_action([this](token_span s) {
+                trace.push_back(s[0].second + "=" + s[1].second);
+            });
+        first = pair_r >> rule(';');
+        first.set_async_action([this](token_span s) { trace.push_back(";" + to_string(s.size())); });
+        second = pair_r >> rule('.');
+        second.set_async_action([this](token_span s) { trace.push_back("." + to_string(s.size())); });
+        item = first | second;
+        root = *item;
+    }
+
+    vector<string> run(const string &input, bool async, engine_t engine) {
+        trace.clear();
+        stringstream str(input);
+        parser_context pc;
+        pc.set_stream(str);
+        pc.set_engine(engine);
+        pc.set_async_actions(async);
+        REQUIRE(parse_all(root, pc));
+        REQUIRE(pc.collect_tokens().empty());
+        return trace;
+    }
+};
+
+TEST_CASE("asynchronous actions run in the synchronous order", "[async]")
+{
+    trace_grammar g;
+    string input;
+    for (int i = 0; i < 500; i++) input += "a" + to_string(i) + " = " + to_string(i) + (i % 3 ? " ;\n" : " .\n");
+
+    for (auto engine : {ENGINE_RECURSIVE, ENGINE_ITERATIVE}) {
+        auto sync = g.run(input, false, engine);
+        // each '.' item invokes pair_r twice (the first alternative fails)
+        REQUIRE(sync.size() == 500 * 2 + 167);
+        REQUIRE(sync[0] == "a0=0");
+        REQUIRE(sync[1] == "a0=0");
+        REQUIRE(sync[2] == ".0");
+        REQUIRE(g.run(input, true, engine) == sync);
+    }
+}
+
+TEST_CASE("asynchronous actions and the context", "[async]")
+{
+    vector<int> values;
+    rule num = rule(tk_int);
+    num.set_async_action([&values](token_span s) { values.push_back(stoi(s[0].second)); });
+    rule r = rule(tk_ident) >> *num;
+
+    parser_context pc;
+    pc.set_async_actions(true);
+    REQUIRE(pc.async_actions());
+
+    stringstream str("x 1 2 3");
+    pc.set_stream(str);
+    REQUIRE(parse_all(r, pc));
+    REQUIRE(values == vector<int>({1, 2, 3}));
+    // the tokens of the actions have been removed
+    auto v = pc.collect_tokens();
+    REQUIRE(v.size() == 1);
+    REQUIRE(v[0].second == "x");
+
+    // the context stays asynchronous after set_stream()
+    stringstream str2("y 4 5");
+    pc.set_stream(str2);
+    REQUIRE(pc.async_actions());
+    REQUIRE(parse_all(r, pc));
+    REQUIRE(values == vector<int>({1, 2, 3, 4, 5}));
+
+    pc.set_async_actions(false);
+    REQUIRE(not pc.async_actions());
+}
+
+TEST_CASE("an exception of an asynchronous action is thrown by wait_actions()", "[async]")
+{
+    int n = 0;
+    rule num = rule(tk_int);
+    num.set_async_action([&n](token_span s) {
+            if (s[0].second == "13") throw runtime_error("unlucky");
+            n++;
+        });
+    rule r = *num;
+
+    string input;
+    for (int i = 0; i < 300; i++) input += to_string(i) + " ";
+
+    parser_context pc;
+    pc.set_async_actions(true);
+    stringstream str(input);
+    pc.set_stream(str);
+    REQUIRE_THROWS_AS(parse_all(r, pc), runtime_error);
+    // the actions after the exception are not run
+    REQUIRE(n == 13);
+
+    // the context can be used again
+    n = 0;
+    stringstream str2("1 2 3");
+    pc.set_stream(str2);
+    REQUIRE(parse_all(r, pc));
+    REQUIRE(n == 3);
+}
+
+TEST_CASE("pending asynchronous actions run before the context is destroyed", "[async]")
+{
+    int n = 0;
+    rule num = rule(tk_int);
+    num.set_async_action([&n](token_span) { n++; });
+    rule r = *num;
+    {
+        parser_context pc;
+        pc.set_async_actions(true);
+        stringstream str("1 2 3 4 5");
+        pc.set_stream(str);
+        REQUIRE(r.parse(pc));
+    }
+    REQUIRE(n == 5);
+}
+
+TEST_CASE("an idle consumer thread does not use the processor", "[async]")
+{
+    int n = 0;
+    rule num = rule(tk_int);
+    num.set_async_action([&n](token_span) { n++; });
+    rule r = *num;
+
+    parser_context pc;
+    pc.set_async_actions(true);
+    stringstream str("1 2 3");
+    pc.set_stream(str);
+    REQUIRE(parse_all(r, pc));
+    REQUIRE(n == 3);
+
+    clock_t c = clock();
+    this_thread::sleep_for(chrono::milliseconds(200));
+    double cpu = double(clock() - c) / CLOCKS_PER_SEC;
+    REQUIRE(cpu < 0.05);
+
+    // the consumer wakes up for the next actions
+    stringstream str2("4 5");
+    pc.set_stream(str2);
+    REQUIRE(parse_all(r, pc));
+    REQUIRE(n == 5);
+}
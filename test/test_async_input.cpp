@@ -0,0 +1,147 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+  
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <tinyparser.hpp>
+#include <async_input.hpp>
+
+using namespace std;
+using namespace tipa;
+
+static string make_input(int n)
+{
+    string s;
+    for (int i = 0; i < n; i++) s += "key" + to_string(i) + " = " + to_string(i) + ";\n";
+    return s;
+}
+
+// parses the list of assignments, and returns the sum of the values
+static long parse_sum(istream &in)
+{
+    long sum = 0;
+    rule assign = rule(tk_ident) >> rule('=') >> rule(tk_int) >> rule(';');
+    assign.set_action([&sum](parser_context &pc) {
+            auto v = pc.collect_tokens();
+            sum += stol(v[1].second);
+        });
+    rule r = *assign;
+
+    parser_context pc;
+    pc.set_stream(in);
+    REQUIRE(parse_all(r, pc));
+    return sum;
+}
+
+TEST_CASE("reading a stream in blocks", "[async_input]")
+{
+    const int n = 2000;
+    const long expected = long(n) * (n - 1) / 2;
+    string s = make_input(n);
+
+    // the lines span two or more blocks
+    for (size_t block : vector<size_t>{1, 7, 100, 4096, TIPA_INPUT_BLOCK}) {
+        stringstream str(s);
+        async_istream in(str, block);
+        REQUIRE(parse_sum(in) == expected);
+    }
+}
+
+TEST_CASE("the async_input returns the whole source", "[async_input]")
+{
+    string s = make_input(300);
+    stringstream str(s);
+    async_input buf(str, 64);
+    REQUIRE(buf.block_size() == 64);
+    istream in(&buf);
+    string out((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    REQUIRE(out == s);
+    // the end of the input is stable
+    REQUIRE(in.get() == EOF);
+}
+
+TEST_CASE("an empty source", "[async_input]")
+{
+    stringstream str("");
+    async_istream in(str, 16);
+    string l;
+    REQUIRE(not getline(in, l));
+}
+
+TEST_CASE("reading a file descriptor", "[async_input]")
+{
+    const int n = 5000;
+    string s = make_input(n);
+
+    char name[] = "/tmp/tipa_async_XXXXXX";
+    int fd = mkstemp(name);
+    REQUIRE(fd >= 0);
+    REQUIRE(write(fd, s.data(), s.size()) == (ssize_t)s.size());
+    REQUIRE(lseek(fd, 0, SEEK_SET) == 0);
+
+    {
+        async_istream in(fd, 1000);
+        REQUIRE(parse_sum(in) == long(n) * (n - 1) / 2);
+    }
+    close(fd);
+    unlink(name);
+}
+
+TEST_CASE("an error of the source sets the badbit", "[async_input]")
+{
+    // not a valid descriptor
+    async_istream in(-1, 16);
+    string l;
+    REQUIRE(not getline(in, l));
+    REQUIRE(in.bad());
+}
+
+TEST_CASE("an error of the source stops the parser", "[async_input]")
+{
+    // reading a directory fails
+    int fd = open("/tmp", O_RDONLY);
+    REQUIRE(fd >= 0);
+    {
+        async_istream in(fd, 16);
+        parser_context pc;
+        // the lexer reads the first line in set_stream()
+        REQUIRE_THROWS_AS((pc.set_stream(in), parse_all(*rule(tk_int), pc)), parse_exc);
+    }
+    close(fd);
+}
+
+TEST_CASE("destroying an async_input before the end", "[async_input]")
+{
+    string s = make_input(10000);
+    stringstream str(s);
+    async_istream in(str, 128);
+    string l;
+    REQUIRE(getline(in, l));
+    REQUIRE(l == "key0 = 0;");
+}
@@ -0,0 +1,143 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+  
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <sstream>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+#include <tinyparser.hpp>
+
+using namespace std;
+using namespace tipa;
+
+namespace {
+    // backtracks exponentially on unbalanced input
+    struct slow_grammar {
+        rule e;
+        rule r;
+        slow_grammar() {
+            e = (rule('(') >> e >> rule(')') >> rule('!')) | (rule('(') >> e >> rule(')')) | rule(tk_int);
+            r = e >> rule('?');
+        }
+    };
+
+    string slow_input() { return string(60, '(') + "1" + string(60, ')') + ";"; }
+}
+
+TEST_CASE("a parse can be cancelled from another thread", "[cancel]")
+{
+    slow_grammar g;
+    rule &r = g.r;
+    for (auto engine : {ENGINE_RECURSIVE, ENGINE_ITERATIVE}) {
+        atomic<bool> cancel(false);
+        stringstream str(slow_input());
+        parser_context pc;
+        pc.set_stream(str);
+        pc.set_engine(engine);
+        pc.set_cancel_flag(&cancel);
+
+        thread t([&cancel]() {
+                this_thread::sleep_for(chrono::milliseconds(20));
+                cancel = true;
+            });
+        bool f = parse_all(r, pc);
+        t.join();
+
+        REQUIRE(not f);
+        REQUIRE(pc.is_halted());
+        REQUIRE(pc.get_last_error().token.first == ERR_PARSE_CANCELLED);
+        REQUIRE(pc.saved_depth() == 0);
+    }
+}
+
+TEST_CASE("the context can be used again after a cancellation", "[cancel]")
+{
+    atomic<bool> cancel(true);
+    parser_context pc;
+    pc.set_cancel_flag(&cancel);
+
+    rule r = rule(tk_int) >> rule(';');
+    stringstream str1("1;");
+    pc.set_stream(str1);
+    REQUIRE(not parse_all(r, pc));
+    REQUIRE(pc.get_last_error().token.first == ERR_PARSE_CANCELLED);
+
+    cancel = false;
+    stringstream str2("2;");
+    pc.set_stream(str2);
+    REQUIRE(parse_all(r, pc));
+    REQUIRE(pc.collect_tokens().size() == 1);
+}
+
+TEST_CASE("the error reports the position reached", "[cancel]")
+{
+    atomic<bool> cancel(false);
+    stringstream str;
+    for (int i = 0; i < 10000; i++) str << i << (i % 10 == 9 ? ",\n" : ", ");
+    str << "end";
+
+    int count = 0;
+    rule elem = rule(tk_int);
+    elem.set_action([&count, &cancel](parser_context &) { if (++count == 5000) cancel = true; });
+    rule l = sep_list_rule(elem) >> rule(',') >> rule("end");
+
+    parser_context pc;
+    pc.set_stream(str);
+    pc.set_cancel_flag(&cancel);
+    REQUIRE(not parse_all(l, pc));
+    REQUIRE(pc.get_last_error().token.first == ERR_PARSE_CANCELLED);
+    // the flag is checked every TIPA_BUDGET_CHECK_STEPS steps
+    REQUIRE(pc.get_last_error().position.first >= 500);
+    REQUIRE(pc.get_last_error().position.first < 1000);
+    // the checkpoints and the tokens have been released
+    REQUIRE(pc.saved_depth() == 0);
+    REQUIRE(pc.collect_tokens().empty());
+}
+
+TEST_CASE("a deadline stops the parsing", "[cancel]")
+{
+    slow_grammar g;
+    rule &r = g.r;
+    stringstream str(slow_input());
+    parser_context pc;
+    pc.set_stream(str);
+
+    auto start = chrono::steady_clock::now();
+    pc.set_deadline(start + chrono::milliseconds(20));
+    REQUIRE(not parse_all(r, pc));
+    REQUIRE(pc.get_last_error().token.first == ERR_PARSE_BUDGET);
+    REQUIRE(chrono::steady_clock::now() - start < chrono::seconds(5));
+
+    // the deadline is kept across set_stream()
+    stringstream str2("1 ?");
+    pc.set_stream(str2);
+    REQUIRE(not parse_all(r, pc));
+    REQUIRE(pc.get_last_error().token.first == ERR_PARSE_BUDGET);
+
+    pc.set_deadline(chrono::steady_clock::time_point::max());
+    stringstream str3("1 ?");
+    pc.set_stream(str3);
+    REQUIRE(parse_all(r, pc));
+}
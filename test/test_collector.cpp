@@ -121,3 +121,23 @@ TEST_CASE( "Collecting a number of strings", "[collector]")
 }
 
 
+
+TEST_CASE( "Backtracking restores the tokens consumed by actions", "[collector]")
+{
+    stringstream str("x 1 ,");
+    parser_context pc;
+    pc.set_stream(str);
+
+    // this action consumes also the identifier, that was collected
+    // before the alternative started
+    rule num = rule(tk_int);
+    num.set_action([](parser_context &pc) { pc.collect_tokens(2); });
+
+    rule expr = rule(tk_ident) >> ((num >> rule(';')) | (rule(tk_int) >> rule(',')));
+
+    REQUIRE(parse_all(expr, pc));
+    auto v = pc.collect_tokens();
+    REQUIRE(v.size() == 2);
+    REQUIRE(v[0].second == "x");
+    REQUIRE(v[1].second == "1");
+}
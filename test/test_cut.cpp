@@ -0,0 +1,92 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <vector>
+#include <sstream>
+
+#include <tinyparser.hpp>
+
+using namespace std;
+using namespace tipa;
+
+TEST_CASE("a cut prevents backtracking", "[cut]")
+{
+    rule with_cut = (rule('a') >> cut() >> rule('b')) | (rule('a') >> rule('c'));
+    rule without_cut = (rule('a') >> rule('b')) | (rule('a') >> rule('c'));
+    parser_context pc;
+
+    SECTION("without cut, the second alternative is tried") {
+        stringstream str("a c");
+        pc.set_stream(str);
+        REQUIRE(parse_all(without_cut, pc));
+    }
+    SECTION("with cut, the parsing fails") {
+        stringstream str("a c");
+        pc.set_stream(str);
+        REQUIRE(not parse_all(with_cut, pc));
+        REQUIRE(pc.is_halted());
+        REQUIRE(pc.get_last_error().token.first == ERR_PARSE_CUT);
+    }
+    SECTION("the first alternative is still accepted") {
+        stringstream str("a b");
+        pc.set_stream(str);
+        REQUIRE(parse_all(with_cut, pc));
+        REQUIRE(not pc.is_halted());
+    }
+}
+
+TEST_CASE("a failure after a cut stops a repetition", "[cut]")
+{
+    rule item = rule(tk_ident) >> rule('=') >> cut() >> rule(tk_int);
+    rule root = *item >> rule(tk_ident);
+
+    stringstream str("a = 1 b = c");
+    parser_context pc;
+    pc.set_stream(str);
+
+    REQUIRE(not parse_all(root, pc));
+    REQUIRE(pc.saved_depth() == 0);
+}
+
+TEST_CASE("a cut releases the input lines", "[cut]")
+{
+    stringstream str;
+    for (int i = 0; i < 1000; i++) str << "line " << i << ";\n";
+
+    parser_context pc;
+    int sum = 0;
+    size_t max_lines = 0;
+    rule item = rule(tk_ident) >> rule(tk_int) >> rule(';');
+    item.set_action([&](parser_context &pc) {
+            string s; int x;
+            read_all(pc, s, x);
+            sum += x;
+            max_lines = max(max_lines, pc.retained_lines());
+        });
+    rule root = *(item >> cut());
+
+    pc.set_stream(str);
+    REQUIRE(parse_all(root, pc));
+    REQUIRE(sum == 999 * 1000 / 2);
+    REQUIRE(max_lines <= 2);
+}
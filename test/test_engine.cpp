@@ -0,0 +1,115 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <sstream>
+#include <vector>
+
+#include <tinyparser.hpp>
+
+using namespace std;
+using namespace tipa;
+
+// a small arithmetic grammar which sums all the integers
+struct sum_grammar {
+    rule expr, term, factor, num;
+    int sum = 0;
+
+    sum_grammar() {
+        num = rule(tk_int);
+        num.set_action([this](parser_context &pc) { int x; read_all(pc, x); sum += x; });
+        factor = num | (rule('(') >> expr >> rule(')'));
+        term = factor >> *(rule('*') >> factor);
+        expr = term >> *((rule('+') | rule('-')) >> term);
+    }
+};
+
+static string nested(int n)
+{
+    // one parenthesis per line, to keep the lines short
+    string s;
+    for (int i = 0; i < n; i++) s += "(\n";
+    s += "1";
+    for (int i = 0; i < n; i++) s += "+1)\n";
+    return s;
+}
+
+TEST_CASE("the iterative engine gives the same results", "[engine]")
+{
+    vector<string> inputs = { "1 + 2 * (3 + 4)", "((1)) * 2 + 3 - (4)", "1 + + 2", "(1 + 2", "" };
+    for (auto &in : inputs) {
+        sum_grammar g1, g2;
+        stringstream s1(in), s2(in);
+        parser_context pc1, pc2;
+        pc1.set_stream(s1);
+        pc2.set_stream(s2);
+        pc2.set_engine(ENGINE_ITERATIVE);
+
+        bool r1 = parse_all(g1.expr, pc1);
+        bool r2 = parse_all(g2.expr, pc2);
+        REQUIRE(r1 == r2);
+        REQUIRE(g1.sum == g2.sum);
+        REQUIRE(pc1.get_pos() == pc2.get_pos());
+        if (!r1) REQUIRE(pc1.get_formatted_err_msg() == pc2.get_formatted_err_msg());
+    }
+}
+
+TEST_CASE("the iterative engine parses deeply nested input", "[engine]")
+{
+    const int n = 100000;
+    sum_grammar g;
+    stringstream str(nested(n));
+    parser_context pc;
+    pc.set_stream(str);
+    pc.set_engine(ENGINE_ITERATIVE);
+
+    REQUIRE(parse_all(g.expr, pc));
+    REQUIRE(g.sum == n + 1);
+    REQUIRE(pc.saved_depth() == 0);
+}
+
+TEST_CASE("the nesting can be limited", "[engine]")
+{
+    for (auto engine : {ENGINE_RECURSIVE, ENGINE_ITERATIVE}) {
+        sum_grammar g;
+        stringstream str(nested(1000));
+        parser_context pc;
+        pc.set_stream(str);
+        pc.set_engine(engine);
+        pc.set_max_depth(500);
+
+        REQUIRE(!parse_all(g.expr, pc));
+        REQUIRE(pc.get_last_error().token.first == ERR_PARSE_DEPTH);
+        REQUIRE(pc.is_halted());
+        REQUIRE(pc.saved_depth() == 0);
+
+        // the same input within the limit
+        sum_grammar g2;
+        stringstream str2(nested(20));
+        parser_context pc2;
+        pc2.set_stream(str2);
+        pc2.set_engine(engine);
+        pc2.set_max_depth(500);
+        REQUIRE(parse_all(g2.expr, pc2));
+        REQUIRE(g2.sum == 21);
+    }
+}
@@ -0,0 +1,141 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+  
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <vector>
+#include <sstream>
+
+#include <tinyparser.hpp>
+
+using namespace std;
+using namespace tipa;
+
+/* Statements that start in the same way, with actions on the
+   expressions and on some statements. */
+struct stmt_grammar {
+    rule expr, primary, stmt, root;
+    vector<string> log;
+
+    stmt_grammar() {
+        primary = rule(tk_int) | rule(tk_ident) | (rule('(') >> expr >> rule(')'));
+        expr = primary >> *(rule('+') >> primary);
+        expr.set_action([this](parser_context &pc) {
+                log.push_back("expr " + to_string(pc.collect_tokens().size()));
+            });
+        rule ret = rule(tk_ident) >> rule(":=") >> expr >> rule(';');
+        ret.set_action([this](parser_context &pc) {
+                log.push_back("ret " + to_string(pc.collect_tokens().size()));
+            });
+        stmt = (rule(tk_ident) >> rule('=') >> expr >> rule(';')) 
+            | (rule(tk_ident) >> rule('=') >> rule('[') >> expr >> rule(']') >> rule(';'))
+            | (rule(tk_ident) >> rule('(') >> -(expr >> *(rule(',') >> expr)) >> rule(')') >> rule(';'))
+            | std::move(ret)
+            | (rule(tk_ident) >> rule(';'))
+            | (expr >> rule(';'));
+        root = *stmt;
+    }
+};
+
+static const vector<string> inputs = {
+    "a = 1 + b; x = [2 + (3 + y)]; f(a, 1 + 2); f(); r := 5; z; 1 + 2;",
+    "f(a, b + ; ",
+    "x = [1 + 2;",
+    "g(1) 5 + (x + y);",
+    "",
+};
+
+TEST_CASE("left factoring does not change the parsing", "[factor]")
+{
+    stmt_grammar g2;
+    auto report = left_factor(g2.stmt);
+    // the first three alternatives are factored, the fourth one has
+    // an action
+    REQUIRE(report.size() == 2);
+    REQUIRE(report[0].find("alternatives 1-3 of 6") == 0);
+    REQUIRE(report[1].find("alternatives 1-2 of 3") == 0);
+    // nothing more to do
+    REQUIRE(left_factor(g2.root).empty());
+
+    for (auto engine : {ENGINE_RECURSIVE, ENGINE_ITERATIVE}) 
+        for (auto &s : inputs) {
+            INFO(s);
+            stmt_grammar g1;
+            g2.log.clear();
+            parser_context pc1, pc2;
+            pc1.set_engine(engine);
+            pc2.set_engine(engine);
+            stringstream s1(s), s2(s);
+            pc1.set_stream(s1);
+            pc2.set_stream(s2);
+            bool r1 = parse_all(g1.root, pc1);
+            bool r2 = parse_all(g2.root, pc2);
+            REQUIRE(r1 == r2);
+            REQUIRE(pc1.get_pos() == pc2.get_pos());
+            REQUIRE(g1.log == g2.log);
+            REQUIRE(pc1.collect_tokens() == pc2.collect_tokens());
+        }
+}
+
+TEST_CASE("rules with side effects are not factored", "[factor]")
+{
+    int n = 0;
+    rule a = rule(tk_ident);
+    a.set_action([&n](parser_context &) { n++; });
+
+    SECTION("an action in the prefix") {
+        rule r = (a >> rule('=')) | (a >> rule(':'));
+        REQUIRE(left_factor(r).empty());
+        stringstream str("x :");
+        parser_context pc;
+        pc.set_stream(str);
+        REQUIRE(parse_all(r, pc));
+        // the action of the first alternative is invoked anyway
+        REQUIRE(n == 2);
+    }
+    SECTION("a cut in the prefix") {
+        rule r = (cut() >> rule('=')) | (cut() >> rule(':'));
+        REQUIRE(left_factor(r).empty());
+    }
+    SECTION("the prefix stops at the first rule with side effects") {
+        rule r1 = (rule(tk_ident) >> a >> rule('=')) | (rule(tk_ident) >> a >> rule(':'));
+        rule r2 = (rule(tk_ident) >> cut() >> rule('=')) | (rule(tk_ident) >> cut() >> rule(':'));
+        for (auto r : {r1, r2}) {
+            auto report = left_factor(r);
+            REQUIRE(report.size() == 1);
+            REQUIRE(report[0] == "alternatives 1-2 of 2 share the prefix TERM: <^[^\\d\\W]\\w*>");
+        }
+    }
+}
+
+TEST_CASE("left factoring of a recursive grammar", "[factor]")
+{
+    rule list;
+    list = (rule(tk_int) >> rule(',') >> list) | rule(tk_int);
+    auto report = left_factor(list);
+    REQUIRE(report.size() == 1);
+
+    stringstream str("1, 2, 3, 4");
+    parser_context pc;
+    pc.set_stream(str);
+    REQUIRE(parse_all(list, pc));
+    REQUIRE(pc.collect_tokens().size() == 4);
+}
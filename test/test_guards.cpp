@@ -0,0 +1,166 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+  
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <chrono>
+
+#include <tinyparser.hpp>
+
+using namespace std;
+using namespace tipa;
+
+TEST_CASE("repetitions of empty rules terminate", "[guards]")
+{
+    rule x = rule(tk_ident);
+    rule a = *(-x) >> rule(';');
+    rule b = *null() >> rule(';');
+    rule o = -x;
+    rule c = sep_list_rule(o) >> rule(';');
+
+    for (auto engine : {ENGINE_RECURSIVE, ENGINE_ITERATIVE}) {
+        for (rule *r : {&a, &b, &c}) {
+            stringstream str("p q ;");
+            parser_context pc;
+            pc.set_stream(str);
+            pc.set_engine(engine);
+            parse_all(*r, pc);
+            REQUIRE(pc.get_steps() < 100);
+        }
+        stringstream str("p q ;");
+        parser_context pc;
+        pc.set_stream(str);
+        pc.set_engine(engine);
+        REQUIRE(parse_all(a, pc));
+        REQUIRE(pc.collect_tokens().size() == 2);
+    }
+}
+
+TEST_CASE("the grammar check finds empty repetitions", "[guards]")
+{
+    rule x = rule(tk_ident);
+    rule bad = *(-x) >> rule(';');
+    auto report = check_grammar(bad);
+    REQUIRE(report.size() == 1);
+    REQUIRE(report[0].find("repetition") != string::npos);
+
+    rule bad2 = +(*x) >> rule(';');
+    REQUIRE(check_grammar(bad2).size() == 1);
+
+    rule good = *(-x >> rule(',')) >> sep_list_rule(x) >> rule(';');
+    REQUIRE(check_grammar(good).empty());
+}
+
+TEST_CASE("the grammar check finds left recursion", "[guards]")
+{
+    rule expr;
+    expr = (expr >> rule('+') >> rule(tk_int)) | rule(tk_int);
+    auto report = check_grammar(expr);
+    REQUIRE(report.size() == 1);
+    REQUIRE(report[0].find("left recursion") != string::npos);
+
+    // indirect, through a nullable prefix
+    rule a, b;
+    a = -rule('-') >> b >> rule(tk_int);
+    b = a | rule(tk_ident);
+    REQUIRE(check_grammar(a).size() == 1);
+
+    // right recursion is fine
+    rule list;
+    list = (rule(tk_int) >> rule(',') >> list) | rule(tk_int);
+    REQUIRE(check_grammar(list).empty());
+}
+
+TEST_CASE("left recursion stops on the depth", "[guards]")
+{
+    rule expr;
+    expr = (expr >> rule('+') >> rule(tk_int)) | rule(tk_int);
+
+    for (auto engine : {ENGINE_RECURSIVE, ENGINE_ITERATIVE}) {
+        stringstream str("1 + 2");
+        parser_context pc;
+        pc.set_stream(str);
+        pc.set_engine(engine);
+        pc.set_max_depth(1000);
+        REQUIRE(not parse_all(expr, pc));
+        REQUIRE(pc.get_last_error().token.first == ERR_PARSE_DEPTH);
+    }
+}
+
+/* Every level tries the same sub-rule twice before failing, so the
+   work doubles at each level of nesting. */
+TEST_CASE("the budget stops exponential backtracking", "[guards]")
+{
+    rule e;
+    e = (rule('(') >> e >> rule(')') >> rule('!')) | (rule('(') >> e >> rule(')')) | rule(tk_int);
+
+    string input(40, '(');
+    input += "1" + string(40, ')') + "?";
+
+    for (auto engine : {ENGINE_RECURSIVE, ENGINE_ITERATIVE}) {
+        stringstream str(input);
+        parser_context pc;
+        pc.set_stream(str);
+        pc.set_engine(engine);
+        pc.set_budget(100000);
+        REQUIRE(not parse_all(e >> rule('?'), pc));
+        REQUIRE(pc.is_halted());
+        REQUIRE(pc.get_last_error().token.first == ERR_PARSE_BUDGET);
+        // the last step is the one refused
+        REQUIRE(pc.get_steps() == 100001);
+    }
+}
+
+TEST_CASE("the time budget", "[guards]")
+{
+    rule e;
+    e = (rule('(') >> e >> rule(')') >> rule('!')) | (rule('(') >> e >> rule(')')) | rule(tk_int);
+
+    string input(40, '(');
+    input += "1" + string(40, ')') + "?";
+
+    for (auto engine : {ENGINE_RECURSIVE, ENGINE_ITERATIVE}) {
+        stringstream str(input);
+        parser_context pc;
+        pc.set_stream(str);
+        pc.set_engine(engine);
+        pc.set_budget(0, chrono::milliseconds(50));
+        auto start = chrono::steady_clock::now();
+        REQUIRE(not parse_all(e >> rule('?'), pc));
+        REQUIRE(pc.get_last_error().token.first == ERR_PARSE_BUDGET);
+        REQUIRE(chrono::steady_clock::now() - start < chrono::seconds(5));
+    }
+}
+
+TEST_CASE("the budget does not change a successful parse", "[guards]")
+{
+    rule e;
+    e = (rule('(') >> e >> rule(')')) | rule(tk_int);
+    stringstream str("((1))");
+    parser_context pc;
+    pc.set_stream(str);
+    pc.set_budget(1000, chrono::milliseconds(1000));
+    REQUIRE(parse_all(e, pc));
+    REQUIRE(pc.get_steps() > 0);
+}
@@ -0,0 +1,137 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+  
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sstream>
+
+#include <tinyparser.hpp>
+
+using namespace std;
+using namespace tipa;
+
+namespace {
+    // the tokens and the positions read from the input
+    vector<string> read_input(parser_context &pc, rule &r, bool &ok)
+    {
+        vector<string> v;
+        ok = parse_all(r, pc);
+        for (auto &t : pc.collect_tokens()) v.push_back(t.second);
+        v.push_back(to_string(pc.get_pos().first) + ":" + to_string(pc.get_pos().second));
+        return v;
+    }
+}
+
+TEST_CASE("a string is read like a stream", "[input]")
+{
+    rule r = *(rule(tk_ident) | rule(tk_int));
+    vector<string> inputs = { "", "\n", "a", "a\n", "a b\n\n c 12", "  x\n y\n\n", "1\n2\n3" };
+
+    for (auto &s : inputs) {
+        INFO("input: \"" << s << "\"");
+        parser_context pc1, pc2;
+        stringstream str(s);
+        pc1.set_stream(str);
+        pc2.set_input(s);
+        bool ok1, ok2;
+        auto v1 = read_input(pc1, r, ok1);
+        auto v2 = read_input(pc2, r, ok2);
+        REQUIRE(ok1 == ok2);
+        REQUIRE(v1 == v2);
+    }
+}
+
+TEST_CASE("errors and comments on a string input", "[input]")
+{
+    rule r = rule(tk_ident) >> rule('=') >> rule(tk_int) >> rule(';');
+    parser_context pc;
+    pc.set_comment("/*", "*/", "//");
+
+    string s = "x /* a comment\n on two lines */ = // and another\n 5 ;";
+    pc.set_input(s);
+    REQUIRE(parse_all(r, pc));
+
+    string bad = "x =\n  y;";
+    pc.set_input(bad);
+    REQUIRE(not parse_all(r, pc));
+    auto em = pc.get_last_error();
+    REQUIRE(em.position.first == 2);
+    REQUIRE(em.line == "  y;");
+}
+
+TEST_CASE("a string input can be pretokenized", "[input]")
+{
+    rule r = *(rule(tk_ident) >> rule('=') >> rule(tk_int) >> rule(';'));
+    parser_context pc;
+    pc.set_input("a = 1;\nb = 2;");
+    pc.pretokenize({ tk_ident, tk_int });
+    REQUIRE(parse_all(r, pc));
+    REQUIRE(pc.collect_tokens().size() == 4);
+}
+
+TEST_CASE("parsing a string without a context", "[input]")
+{
+    int sum = 0;
+    rule r = rule(tk_int) >> *((rule('+', true) | rule('-', true)) >> rule(tk_int));
+    r.set_action([&sum](parser_context &pc) {
+            auto v = pc.collect_tokens();
+            sum = stoi(v[0].second);
+            for (size_t i = 1; i < v.size(); i += 2)
+                sum += (v[i].second == "+" ? 1 : -1) * stoi(v[i + 1].second);
+        });
+
+    REQUIRE(parse_all(r, "1 + 2 - 4"));
+    REQUIRE(sum == -1);
+    REQUIRE(parse_all(r, string_view("10 + 20 + 30; ignored", 12)));
+    REQUIRE(sum == 60);
+    REQUIRE(not parse_all(r, "1 + "));
+}
+
+TEST_CASE("parsing a string does not depend on the context pool", "[input]")
+{
+    rule e;
+    e = rule(tk_int) | (rule('(') >> e >> rule(')'));
+    REQUIRE(parse_all(e, "((((1))))"));
+
+    {
+        // another user of the pool of this thread
+        auto pc = context_pool::local().acquire();
+        pc->set_max_depth(3);
+        pc->set_comment("(", ")", "//");
+    }
+    REQUIRE(parse_all(e, "((((1))))"));
+}
+
+TEST_CASE("parsing a string from an action", "[input]")
+{
+    int inner = 0;
+    rule num = rule(tk_int);
+    rule quoted = rule(tk_ident);
+    quoted.set_action([&](parser_context &pc) {
+            pc.collect_tokens();
+            if (parse_all(num, "42")) inner++;
+        });
+    REQUIRE(parse_all(*quoted, "a b c"));
+    REQUIRE(inner == 3);
+}
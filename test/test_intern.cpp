@@ -0,0 +1,131 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+  
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <vector>
+#include <sstream>
+
+#include <tinyparser.hpp>
+
+using namespace std;
+using namespace tipa;
+
+TEST_CASE("identical terminals are shared", "[intern]")
+{
+    rule r = (rule('{') >> rule(tk_ident) >> rule('}')) | (rule('{') >> rule(tk_int) >> rule('}'));
+    // 1 alternative, 4 sequences, 4 terminals ('{' and '}' once)
+    REQUIRE(count_nodes(r) == 9);
+
+    stringstream str("{ 12 }");
+    parser_context pc;
+    pc.set_stream(str);
+    REQUIRE(parse_all(r, pc));
+    auto v = pc.collect_tokens();
+    REQUIRE(v.size() == 1);
+    REQUIRE(v[0].second == "12");
+
+    // the collect flag is part of the terminal
+    rule c = rule(';') >> rule(';', true);
+    REQUIRE(count_nodes(c) == 3);
+}
+
+TEST_CASE("identical temporary rules are shared", "[intern]")
+{
+    rule a = *(rule(',') >> rule(tk_int));
+    rule b = *(rule(',') >> rule(tk_int));
+    REQUIRE(count_nodes(a) == 4);
+
+    // a and b are moved into r, so they are the same rule
+    rule r = rule(tk_ident) >> std::move(a) >> rule(';') >> std::move(b);
+    // 3 sequences, the repetition and its 3 nodes, tk_ident and ';'
+    REQUIRE(count_nodes(r) == 9);
+
+    stringstream str("x , 1, 2; , 3");
+    parser_context pc;
+    pc.set_stream(str);
+    REQUIRE(parse_all(r, pc));
+    REQUIRE(pc.collect_tokens().size() == 4);
+}
+
+TEST_CASE("rules with actions and referenced rules are not shared", "[intern]")
+{
+    vector<string> out;
+    rule x = rule(tk_int);
+    x.set_action([&out](parser_context &pc) { out.push_back("x" + pc.collect_tokens().back().second); });
+    rule y = rule(tk_int);
+    y.set_action([&out](parser_context &pc) { out.push_back("y" + pc.collect_tokens().back().second); });
+
+    rule r1 = std::move(x) >> rule(tk_int) >> std::move(y);
+    REQUIRE(count_nodes(r1) == 5);
+
+    // lvalues are referenced, and can still be changed
+    rule z = rule(tk_int);
+    rule w = rule(tk_int);
+    rule r2 = z >> w;
+    REQUIRE(count_nodes(r2) == 3);
+    w.set_action([&out](parser_context &pc) { out.push_back("w" + pc.collect_tokens().back().second); });
+
+    rule r = r1 >> r2;
+    for (auto engine : {ENGINE_RECURSIVE, ENGINE_ITERATIVE}) {
+        out.clear();
+        stringstream str("1 2 3 4 5");
+        parser_context pc;
+        pc.set_engine(engine);
+        pc.set_stream(str);
+        REQUIRE(parse_all(r, pc));
+        REQUIRE(out == vector<string>({"x1", "y3", "w5"}));
+    }
+}
+
+TEST_CASE("a rule passed with std::move() can still get an action", "[intern]")
+{
+    int n1 = 0;
+    rule g1_item = rule(tk_int) >> rule(';');
+    rule g1 = rule('{') >> std::move(g1_item);
+    // not shared yet: the action is set on g1 only
+    REQUIRE_NOTHROW(g1_item.set_action([&n1](parser_context &) { n1++; }));
+
+    int n2 = 0;
+    rule g2_item = rule(tk_int) >> rule(';');
+    rule g2 = rule('{') >> std::move(g2_item);
+    REQUIRE_NOTHROW(g2_item.set_action([&n2](parser_context &) { n2++; }));
+
+    stringstream str("{ 1 ;");
+    parser_context pc;
+    pc.set_stream(str);
+    REQUIRE(parse_all(g2, pc));
+    REQUIRE(n1 == 0);
+    REQUIRE(n2 == 1);
+}
+
+TEST_CASE("a shared rule cannot be changed", "[intern]")
+{
+    rule a_item = rule(tk_ident) >> rule('=');
+    rule a = rule('[') >> std::move(a_item);
+    rule b_item = rule(tk_ident) >> rule('=');
+    rule b = rule('[') >> std::move(b_item);
+
+    // a_item is now part of both grammars, and b_item of none
+    REQUIRE_THROWS_AS(a_item.set_action([](parser_context &) {}), parse_exc);
+    REQUIRE_THROWS_AS(b_item.set_span_action([](parser_context &, token_span) {}), parse_exc);
+    REQUIRE_THROWS_AS(b_item = rule(tk_int), parse_exc);
+}
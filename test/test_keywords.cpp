@@ -0,0 +1,131 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+  
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+
+#include <tinyparser.hpp>
+
+using namespace std;
+using namespace tipa;
+
+TEST_CASE("a set of keywords", "[keywords]")
+{
+    map<string, int> values;
+
+    rule property = keywords({"wcet", "dline", "period", "offset"}) >> rule('=') >> rule(tk_int);
+    property.set_action([&values](parser_context &pc) {
+            string name; int v;
+            read_all(pc, name, v);
+            values[name] = v;
+        });
+    rule root = rule("{") >> list_rule(std::move(property), ";") >> rule("}");
+
+    parser_context pc;
+
+    SECTION("all keywords are recognized") {
+        stringstream str("{ wcet = 5; dline = 10; offset = 0; period = 15 }  ");
+        pc.set_stream(str);
+        REQUIRE(parse_all(root, pc));
+        REQUIRE(values.size() == 4);
+        REQUIRE(values["wcet"] == 5);
+        REQUIRE(values["dline"] == 10);
+        REQUIRE(values["offset"] == 0);
+        REQUIRE(values["period"] == 15);
+    }
+    SECTION("other identifiers are not keywords") {
+        stringstream str("{ wcet = 5; dlines = 10 }");
+        pc.set_stream(str);
+        REQUIRE(not parse_all(root, pc));
+    }
+    SECTION("a keyword is a whole identifier") {
+        stringstream str("periodic");
+        pc.set_stream(str);
+        rule k = keywords({"period", "offset"});
+        REQUIRE(not k.parse(pc));
+        REQUIRE(pc.get_pos().second == 0);
+        REQUIRE(keywords({"periodic"}).parse(pc));
+        REQUIRE(pc.eof());
+    }
+}
+
+TEST_CASE("a large set of keywords", "[keywords]")
+{
+    vector<string> keys;
+    for (int i = 0; i < 300; i++) keys.push_back("k" + to_string(i * 7));
+    rule k = keywords(keys, false);
+
+    for (int i = 0; i < 2100; i++) {
+        stringstream str("k" + to_string(i));
+        parser_context pc;
+        pc.set_stream(str);
+        INFO(i);
+        REQUIRE(k.parse(pc) == (i % 7 == 0));
+        REQUIRE(pc.collect_tokens().empty());
+    }
+}
+
+TEST_CASE("invalid sets of keywords", "[keywords]")
+{
+    REQUIRE_THROWS_AS(keywords({}), parse_exc);
+    REQUIRE_THROWS_AS(keywords({"a", "b", "a"}), parse_exc);
+    REQUIRE_THROWS_AS(keywords({"a", "2b"}), parse_exc);
+    REQUIRE_THROWS_AS(keywords({"a b"}), parse_exc);
+}
+
+TEST_CASE("dispatching on a keyword", "[keywords]")
+{
+    vector<string> out;
+
+    rule name_body = rule('{') >> rule(tk_ident) >> rule('}');
+    rule sw = keyword_switch({
+            {"name", name_body},
+            {"size", rule('=') >> rule(tk_int)},
+            {"end", null()}
+        });
+    sw.set_action([&out](parser_context &pc) {
+            string s;
+            for (auto &t : pc.collect_tokens()) s += t.second + " ";
+            out.push_back(s);
+        });
+    rule root = *sw >> rule(';');
+
+    for (auto engine : {ENGINE_RECURSIVE, ENGINE_ITERATIVE}) {
+        out.clear();
+        parser_context pc;
+        pc.set_engine(engine);
+
+        stringstream str("name { x } size = 5 end name { y } ;");
+        pc.set_stream(str);
+        REQUIRE(parse_all(root, pc));
+        REQUIRE(out == vector<string>({"name x ", "size 5 ", "end ", "name y "}));
+
+        // the continuation fails: the keyword is not consumed
+        stringstream str2("size = x");
+        pc.set_stream(str2);
+        REQUIRE(not sw.parse(pc));
+        REQUIRE(pc.get_pos().second == 0);
+        REQUIRE(pc.collect_tokens().empty());
+    }
+}
@@ -334,3 +334,30 @@ TEST_CASE("skip comments", "[lexer]")
     REQUIRE(tk.first == tk_int.get_name());
     REQUIRE(tk.second == "235");
 }
+
+TEST_CASE("repeated attempts at the same position", "[lexer]")
+{
+    lexer lex;
+    stringstream str("abc + 123\ndef");
+    lex.set_stream(str);
+
+    REQUIRE(lex.try_token(tk_int).first == LEX_ERROR);
+    REQUIRE(lex.try_token(tk_int).first == LEX_ERROR);
+    REQUIRE(lex.cached_attempts() == 1);
+
+    lex.save();
+    REQUIRE(lex.try_token(tk_ident).second == "abc");
+    REQUIRE(lex.try_token(token(tk_char.get_name(), "-")).first == LEX_ERROR);
+    REQUIRE(lex.restore());
+    token_val tk = lex.try_token(tk_ident);
+    REQUIRE(tk.first == tk_ident.get_name());
+    REQUIRE(tk.second == "abc");
+    REQUIRE(lex.cached_attempts() == 2);
+
+    // two literals with the same identifier are different tokens
+    REQUIRE(lex.try_token(token(tk_char.get_name(), "\\+")).second == "+");
+    REQUIRE(lex.cached_attempts() == 2);
+    REQUIRE(lex.try_token(tk_int).second == "123");
+    REQUIRE(lex.try_token(tk_ident).second == "def");
+    REQUIRE(lex.eof());
+}
@@ -129,3 +129,143 @@ TEST_CASE("parsing a list of properties", "[list]")
     REQUIRE(values["dline"] == 10);
     REQUIRE(values["period"] == 15);
 }
+
+TEST_CASE("one or more repetitions", "[list]")
+{
+    rule r = +rule(tk_int) >> rule(';');
+    parser_context pc;
+
+    SECTION("at least one") {
+        stringstream str("1 2 3;");
+        pc.set_stream(str);
+        REQUIRE(parse_all(r, pc));
+        REQUIRE(pc.collect_tokens().size() == 3);
+    }
+    SECTION("zero is not enough") {
+        stringstream str(";");
+        pc.set_stream(str);
+        REQUIRE(not parse_all(r, pc));
+    }
+}
+
+TEST_CASE("bounded repetitions", "[list]")
+{
+    rule r = repeat_rule(rule(tk_ident), 2, 3);
+    parser_context pc;
+
+    SECTION("stops at the maximum") {
+        stringstream str("a b c d");
+        pc.set_stream(str);
+        REQUIRE(r.parse(pc));
+        REQUIRE(pc.collect_tokens().size() == 3);
+        REQUIRE(not pc.eof());
+    }
+    SECTION("fewer than the minimum restores the context") {
+        stringstream str("a 1");
+        pc.set_stream(str);
+        REQUIRE(not r.parse(pc));
+        REQUIRE(pc.collect_tokens().size() == 0);
+        REQUIRE(pc.get_pos().second == 0);
+        REQUIRE(pc.saved_depth() == 0);
+    }
+    SECTION("the minimum cannot exceed the maximum") {
+        REQUIRE_THROWS_AS(repeat_rule(rule(tk_ident), 3, 2), parse_exc);
+        rule a = rule(tk_ident);
+        REQUIRE_THROWS_AS(repeat_rule(a, 1, 0), parse_exc);
+    }
+}
+
+TEST_CASE("iterative list of elements", "[list]")
+{
+    vector<int> values;
+    rule l = sep_list_rule(rule(tk_int)) >> -rule(',') >> rule(';');
+    l.set_action([&values](parser_context &pc) {
+            for (auto &t : pc.collect_tokens()) values.push_back(stoi(t.second));
+        });
+    parser_context pc;
+
+    SECTION("the elements are read left to right") {
+        stringstream str("1, 2, 3, 4;");
+        pc.set_stream(str);
+        REQUIRE(parse_all(l, pc));
+        REQUIRE(values == vector<int>({1, 2, 3, 4}));
+    }
+    SECTION("a trailing separator is left to the next rule") {
+        stringstream str("1, 2, 3,;");
+        pc.set_stream(str);
+        REQUIRE(parse_all(l, pc));
+        REQUIRE(values == vector<int>({1, 2, 3}));
+    }
+    SECTION("the list cannot be empty") {
+        stringstream str(";");
+        pc.set_stream(str);
+        REQUIRE(not parse_all(l, pc));
+    }
+}
+
+TEST_CASE("long lists do not exhaust the stack", "[list]")
+{
+    const int n = 100000;
+    stringstream str;
+    for (int i = 0; i < n; i++) str << i << (i % 10 == 9 ? ",\n" : ", ");
+    str << "end";
+
+    long sum = 0;
+    rule l = sep_list_rule(rule(tk_int)) >> rule(',') >> rule("end");
+    l.set_action([&sum](parser_context &pc) {
+            auto v = pc.collect_tokens();
+            for (auto &t : v) if (t.first == tk_int.get_name()) sum += stol(t.second);
+        });
+
+    parser_context pc;
+    pc.set_stream(str);
+    REQUIRE(parse_all(l, pc));
+    REQUIRE(sum == long(n) * (n - 1) / 2);
+}
+
+TEST_CASE("span actions receive all the elements at once", "[list]")
+{
+    vector<int> values;
+    values.reserve(16);
+    int calls = 0;
+
+    rule elem = rule(tk_int);
+    rule l = sep_list_rule(elem);
+    l.set_span_action([&values, &calls](parser_context &, token_span s) {
+            calls++;
+            for (auto &t : s) values.push_back(stoi(t.second));
+        });
+    rule r = rule(tk_ident) >> l >> rule(';');
+
+    for (auto engine : {ENGINE_RECURSIVE, ENGINE_ITERATIVE}) {
+        values.clear();
+        calls = 0;
+        stringstream str("abc 1, 2, 3, 4 ;");
+        parser_context pc;
+        pc.set_stream(str);
+        pc.set_engine(engine);
+        REQUIRE(parse_all(r, pc));
+        REQUIRE(calls == 1);
+        REQUIRE(values == vector<int>({1, 2, 3, 4}));
+        // only the tokens of the list have been consumed
+        auto v = pc.collect_tokens();
+        REQUIRE(v.size() == 1);
+        REQUIRE(v[0].second == "abc");
+    }
+}
+
+TEST_CASE("span actions on a failed alternative", "[list]")
+{
+    int n = 0;
+    rule l = *rule(tk_int);
+    l.set_span_action([&n](parser_context &, token_span s) { n += s.size(); });
+    rule r = (l >> rule(';')) | (l >> rule('.'));
+
+    stringstream str("1 2 3 .");
+    parser_context pc;
+    pc.set_stream(str);
+    REQUIRE(parse_all(r, pc));
+    // the action is invoked by both alternatives
+    REQUIRE(n == 6);
+    REQUIRE(pc.collect_tokens().empty());
+}
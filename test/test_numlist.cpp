@@ -0,0 +1,180 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <cstdint>
+
+#include <tinyparser.hpp>
+
+using namespace std;
+using namespace tipa;
+
+TEST_CASE("number lists on several lines", "[numlist]")
+{
+    vector<int> v;
+    rule r = rule(tk_ident) >> number_list_rule(v) >> rule(';');
+
+    stringstream str("data 1, 22 ,333,\n"
+                     "  4444, 123456789 // a comment\n"
+                     ", 12345678 , -5, 0,\n"
+                     "\n"
+                     "7;");
+    parser_context pc;
+    pc.set_comment("/*", "*/", "//");
+    pc.set_stream(str);
+    REQUIRE(parse_all(r, pc));
+    REQUIRE(v == vector<int>({1, 22, 333, 4444, 123456789, 12345678, -5, 0, 7}));
+}
+
+TEST_CASE("number lists stop at the last complete element", "[numlist]")
+{
+    vector<unsigned> v;
+    rule r = number_list_rule(v) >> rule(',') >> rule(tk_ident);
+
+    SECTION("on the same line") {
+        stringstream str("1, 2, x");
+        parser_context pc;
+        pc.set_stream(str);
+        REQUIRE(parse_all(r, pc));
+        REQUIRE(v == vector<unsigned>({1, 2}));
+    }
+    SECTION("on the next line") {
+        stringstream str("1, 2,\n x");
+        parser_context pc;
+        pc.set_stream(str);
+        REQUIRE(parse_all(r, pc));
+        REQUIRE(v == vector<unsigned>({1, 2}));
+        REQUIRE(pc.saved_depth() == 0);
+    }
+    SECTION("numbers must end on a word boundary") {
+        stringstream str("1, 2, 3x");
+        parser_context pc;
+        pc.set_stream(str);
+        REQUIRE(!parse_all(r, pc));
+        REQUIRE(v == vector<unsigned>({1, 2}));
+    }
+    SECTION("negative numbers are not unsigned") {
+        stringstream str("1, -2");
+        parser_context pc;
+        pc.set_stream(str);
+        REQUIRE(!parse_all(r, pc));
+    }
+}
+
+TEST_CASE("number lists give the same results as the general rules", "[numlist]")
+{
+    string input;
+    for (long i = 0; i < 20000; i++) {
+        long x = (i * 2654435761L) % 100000000000L;
+        input += to_string(i % 3 ? x : -x) + (i % 10 == 9 ? ",\n" : ", ");
+    }
+    input += "end";
+
+    vector<long> v1, v2;
+    rule num = rule(create_lib_token("^-?\\d+\\b"));
+    num.set_action([&v1](parser_context &pc) { long x; read_all(pc, x); v1.push_back(x); });
+    rule r1 = sep_list_rule(num) >> rule(',') >> rule("end");
+    rule r2 = number_list_rule(v2) >> rule(',') >> rule("end");
+
+    stringstream s1(input), s2(input);
+    parser_context pc1, pc2;
+    pc1.set_stream(s1);
+    pc2.set_stream(s2);
+    REQUIRE(parse_all(r1, pc1));
+    REQUIRE(parse_all(r2, pc2));
+    REQUIRE(v1.size() == 20000);
+    REQUIRE(v1 == v2);
+    REQUIRE(pc1.get_pos() == pc2.get_pos());
+}
+
+TEST_CASE("number lists of other types", "[numlist]")
+{
+    SECTION("64 bits") {
+        vector<uint64_t> v;
+        rule r = number_list_rule(v, ';');
+        stringstream str("18446744073709551615; 99999999999999999; 0");
+        parser_context pc;
+        pc.set_stream(str);
+        REQUIRE(parse_all(r, pc));
+        REQUIRE(v == vector<uint64_t>({18446744073709551615ULL, 99999999999999999ULL, 0}));
+    }
+    SECTION("out of range") {
+        vector<int16_t> v;
+        rule r = number_list_rule(v);
+        stringstream str("1, 2,\n 32768");
+        parser_context pc;
+        pc.set_stream(str);
+        REQUIRE(!parse_all(r, pc));
+        REQUIRE(v.empty());
+        REQUIRE(pc.get_last_error().token.first == ERR_PARSE_CONV);
+        REQUIRE(pc.get_last_error().token.second == "32768");
+    }
+    SECTION("floating point") {
+        vector<double> v;
+        rule r = number_list_rule(v);
+        stringstream str("1.5, -2, 3e2,\n0.25");
+        parser_context pc;
+        pc.set_stream(str);
+        REQUIRE(parse_all(r, pc));
+        REQUIRE(v == vector<double>({1.5, -2, 300, 0.25}));
+    }
+    SECTION("inf and nan are not numbers") {
+        vector<double> v;
+        rule r = number_list_rule(v) >> rule(',') >> rule(tk_ident);
+        stringstream str("1.5, inf");
+        parser_context pc;
+        pc.set_stream(str);
+        REQUIRE(parse_all(r, pc));
+        REQUIRE(v == vector<double>({1.5}));
+
+        stringstream str2("nan, 1");
+        pc.set_stream(str2);
+        REQUIRE(!parse_all(number_list_rule(v), pc));
+    }
+    SECTION("8 bits") {
+        vector<int8_t> v;
+        vector<uint8_t> u;
+        rule r = number_list_rule(v) >> rule(';') >> number_list_rule(u);
+        stringstream str("-128, 127; 255, 0");
+        parser_context pc;
+        pc.set_stream(str);
+        REQUIRE(parse_all(r, pc));
+        REQUIRE(v == vector<int8_t>({-128, 127}));
+        REQUIRE(u == vector<uint8_t>({255, 0}));
+
+        stringstream str2("256");
+        pc.set_stream(str2);
+        REQUIRE(!parse_all(number_list_rule(u), pc));
+        REQUIRE(pc.get_last_error().token.first == ERR_PARSE_CONV);
+    }
+    SECTION("minimum length") {
+        vector<int> v;
+        rule r = number_list_rule(v, ',', 3) | rule(tk_int) >> rule(',') >> rule(tk_int);
+        stringstream str("1, 2");
+        parser_context pc;
+        pc.set_stream(str);
+        REQUIRE(parse_all(r, pc));
+        REQUIRE(v.empty());
+    }
+}
@@ -0,0 +1,198 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <functional>
+
+#include <tinyparser.hpp>
+
+using namespace std;
+using namespace tipa;
+
+// evaluates expressions with 14 levels of precedence
+struct calculator {
+    rule expr, primary, num;
+    vector<long> st;
+    int nops = 0;
+
+    action_t bin(function<long(long, long)> f) {
+        return [this, f](parser_context &) {
+            long r = st.back(); st.pop_back();
+            long l = st.back(); st.pop_back();
+            st.push_back(f(l, r));
+            nops++;
+        };
+    }
+    action_t un(function<long(long)> f) {
+        return [this, f](parser_context &) { st.back() = f(st.back()); nops++; };
+    }
+
+    calculator() {
+        num = rule(tk_int);
+        num.set_action([this](parser_context &pc) { long x; int i; read_all(pc, i); x = i; st.push_back(x); });
+        primary = num | (rule('(') >> expr >> rule(')'));
+        expr = operator_table_rule(primary, {
+                {"??", OP_RIGHT, 1, bin([](long a, long b) { return a ? a : b; })},
+                {"||", OP_LEFT, 2, bin([](long a, long b) { return a || b; })},
+                {"&&", OP_LEFT, 3, bin([](long a, long b) { return a && b; })},
+                {'|', OP_LEFT, 4, bin([](long a, long b) { return a | b; })},
+                {'^', OP_LEFT, 5, bin([](long a, long b) { return a ^ b; })},
+                {'&', OP_LEFT, 6, bin([](long a, long b) { return a & b; })},
+                {"==", OP_LEFT, 7, bin([](long a, long b) { return a == b; })},
+                {"!=", OP_LEFT, 7, bin([](long a, long b) { return a != b; })},
+                {'<', OP_LEFT, 8, bin([](long a, long b) { return a < b; })},
+                {"<=", OP_LEFT, 8, bin([](long a, long b) { return a <= b; })},
+                {'>', OP_LEFT, 8, bin([](long a, long b) { return a > b; })},
+                {">=", OP_LEFT, 8, bin([](long a, long b) { return a >= b; })},
+                {"<<", OP_LEFT, 9, bin([](long a, long b) { return a << b; })},
+                {">>", OP_LEFT, 9, bin([](long a, long b) { return a >> b; })},
+                {'+', OP_LEFT, 10, bin([](long a, long b) { return a + b; })},
+                {'-', OP_LEFT, 10, bin([](long a, long b) { return a - b; })},
+                {'*', OP_LEFT, 11, bin([](long a, long b) { return a * b; })},
+                {'/', OP_LEFT, 11, bin([](long a, long b) { return a / b; })},
+                {'%', OP_LEFT, 11, bin([](long a, long b) { return a % b; })},
+                {"max", OP_LEFT, 12, bin([](long a, long b) { return a > b ? a : b; })},
+                {'-', OP_PREFIX, 13, un([](long a) { return -a; })},
+                {'!', OP_PREFIX, 13, un([](long a) { return !a; })},
+                {'~', OP_PREFIX, 13, un([](long a) { return ~a; })},
+                {"**", OP_RIGHT, 14, bin([](long a, long b) { long r = 1; while (b-- > 0) r *= a; return r; })}
+            });
+    }
+
+    bool eval(const string &s, long &res, engine_t e = ENGINE_RECURSIVE) {
+        stringstream str(s);
+        parser_context pc;
+        pc.set_stream(str);
+        pc.set_engine(e);
+        st.clear();
+        if (!parse_all(expr, pc)) return false;
+        REQUIRE(st.size() == 1);
+        res = st.back();
+        return true;
+    }
+};
+
+TEST_CASE("operator table precedence and associativity", "[optable]")
+{
+    vector<pair<string, long>> cases = {
+        { "1 + 2 * 3 - 4 / 2", 1 + 2 * 3 - 4 / 2 },
+        { "7 - 3 - 2", 2 },
+        { "2 ** 3 ** 2", 512 },
+        { "-2 ** 2", -4 },
+        { "1 << 2 + 1", 8 },
+        { "1 < 2 == 1", 1 },
+        { "0 ?? 5 ?? 6", 5 },
+        { "3 max 4 * 2", 8 },
+        { "!0 + ~0", 0 },
+        { "(1 + 2) * 3", 9 },
+        { "-(1 + 2) * -3", 9 },
+        { "1 | 6 ^ 3 & 5", 1 | (6 ^ (3 & 5)) },
+        { "2 >= 1 && 3 != 3 || 4 <= 4", 1 },
+        { "17 % 5 >> 1", 1 },
+        { "--3", 3 },
+        { "42", 42 },
+    };
+    calculator c;
+    for (auto &x : cases) {
+        long r = 0;
+        INFO(x.first);
+        REQUIRE(c.eval(x.first, r));
+        REQUIRE(r == x.second);
+        REQUIRE(c.eval(x.first, r, ENGINE_ITERATIVE));
+        REQUIRE(r == x.second);
+    }
+}
+
+TEST_CASE("operator table errors and backtracking", "[optable]")
+{
+    calculator c;
+    long r;
+    REQUIRE(!c.eval("1 + * 2", r));
+    REQUIRE(!c.eval("(1 + 2", r));
+    REQUIRE(!c.eval("3 maxi", r));
+    REQUIRE(!c.eval("", r));
+
+    // an operator without its operand is left to the following rules
+    rule stmt = c.expr >> rule('+') >> rule(';');
+    stringstream str("1 * 2 + ;");
+    parser_context pc;
+    pc.set_stream(str);
+    REQUIRE(parse_all(stmt, pc));
+    REQUIRE(c.st.size() == 1);
+    REQUIRE(c.st.back() == 2);
+    REQUIRE(pc.saved_depth() == 0);
+}
+
+TEST_CASE("operator table actions on the context after a missing operand", "[optable]")
+{
+    // the actions consume the collected tokens and push the result
+    auto op = [](function<int(int, int)> f) {
+        return [f](parser_context &pc) {
+            int a, b;
+            read_all(pc, a, b);
+            pc.push_token(to_string(f(a, b)));
+        };
+    };
+    rule num = rule(tk_int);
+    rule expr = operator_table_rule(num, {
+            {'*', OP_LEFT, 2, op([](int a, int b) { return a * b; })},
+            {'+', OP_LEFT, 1, op([](int a, int b) { return a + b; })}
+        });
+    rule stmt = expr >> rule('+') >> rule(';');
+
+    for (auto engine : {ENGINE_RECURSIVE, ENGINE_ITERATIVE}) {
+        stringstream str("2 * 3 + ;");
+        parser_context pc;
+        pc.set_stream(str);
+        pc.set_engine(engine);
+        REQUIRE(parse_all(stmt, pc));
+        auto v = pc.collect_tokens();
+        REQUIRE(v.size() == 1);
+        REQUIRE(v[0].second == "6");
+        REQUIRE(pc.saved_depth() == 0);
+    }
+}
+
+TEST_CASE("operator table actions are invoked once per operator", "[optable]")
+{
+    calculator c;
+    long r;
+    REQUIRE(c.eval("1 + 2 * 3 ** 2 - -4", r));
+    REQUIRE(r == 1 + 2 * 9 + 4);
+    REQUIRE(c.nops == 5);
+}
+
+TEST_CASE("operator table with deeply nested input", "[optable]")
+{
+    const int n = 20000;
+    string s;
+    for (int i = 0; i < n; i++) s += "(\n";
+    s += "0";
+    for (int i = 0; i < n; i++) s += "+1)\n";
+
+    calculator c;
+    long r;
+    REQUIRE(c.eval(s, r, ENGINE_ITERATIVE));
+    REQUIRE(r == n);
+}
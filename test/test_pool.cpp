@@ -0,0 +1,142 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+  
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <tinyparser.hpp>
+
+using namespace std;
+using namespace tipa;
+
+TEST_CASE("a context can parse many inputs", "[pool]")
+{
+    rule r = sep_list_rule(rule(tk_ident) >> rule('=') >> rule(tk_int)) >> rule(';');
+    parser_context pc;
+    pc.set_comment("/*", "*/", "//");
+
+    for (int i = 0; i < 100; i++) {
+        stringstream str("a = " + to_string(i) + ", /* skipped */ b = 2;");
+        pc.set_stream(str);
+        REQUIRE(parse_all(r, pc));
+        auto v = pc.collect_tokens();
+        REQUIRE(v.size() == 4);
+        REQUIRE(v[1].second == to_string(i));
+    }
+}
+
+TEST_CASE("reset forgets the previous input", "[pool]")
+{
+    rule r = rule(tk_int) >> rule(';');
+    parser_context pc;
+
+    stringstream str1("1 x");
+    pc.set_stream(str1);
+    REQUIRE(not parse_all(r, pc));
+    REQUIRE(pc.get_last_error().token.first != 0);
+
+    pc.reset();
+    REQUIRE(pc.get_last_error().token.first == 0);
+    REQUIRE(pc.collect_tokens().empty());
+    REQUIRE(pc.saved_depth() == 0);
+
+    stringstream str2("2;");
+    pc.set_stream(str2);
+    REQUIRE(parse_all(r, pc));
+    REQUIRE(pc.get_pos().first == 1);
+}
+
+TEST_CASE("the contexts go back to the pool", "[pool]")
+{
+    context_pool pool(2);
+    REQUIRE(pool.size() == 0);
+
+    parser_context *first;
+    {
+        auto pc = pool.acquire();
+        first = pc.get();
+        stringstream str("1 2 3");
+        pc->set_stream(str);
+        REQUIRE(parse_all(*rule(tk_int), *pc));
+        REQUIRE(pool.size() == 0);
+    }
+    REQUIRE(pool.size() == 1);
+
+    {
+        auto a = pool.acquire();
+        auto b = pool.acquire();
+        auto c = pool.acquire();
+        REQUIRE(a.get() == first);
+        // the context has been reset
+        REQUIRE(a->collect_tokens().empty());
+    }
+    // at most 2 contexts are kept
+    REQUIRE(pool.size() == 2);
+}
+
+TEST_CASE("each thread has its own pool", "[pool]")
+{
+    REQUIRE(&context_pool::local() == &context_pool::local());
+
+    rule r = rule(tk_ident) >> rule(';');
+    for (int i = 0; i < 10; i++) {
+        auto pc = context_pool::local().acquire();
+        stringstream str("x;");
+        pc->set_stream(str);
+        REQUIRE(parse_all(r, *pc));
+    }
+    REQUIRE(context_pool::local().size() == 1);
+}
+
+TEST_CASE("the settings of a request do not go to the next user", "[pool]")
+{
+    rule r = rule(tk_int) >> rule(';');
+    context_pool pool;
+    {
+        auto pc = pool.acquire();
+        pc->set_deadline(chrono::steady_clock::now() + chrono::milliseconds(1));
+        atomic<bool> cancel(false);
+        pc->set_cancel_flag(&cancel);
+        pc->set_trace(16);
+        pc->set_max_depth(50);
+    }
+    this_thread::sleep_for(chrono::milliseconds(5));
+
+    auto pc = pool.acquire();
+    REQUIRE(not pc->tracing());
+    // the configuration is kept
+    stringstream deep(string(60, '(') + "1" + string(60, ')'));
+    rule e;
+    e = rule(tk_int) | (rule('(') >> e >> rule(')'));
+    pc->set_stream(deep);
+    REQUIRE(not parse_all(e, *pc));
+    REQUIRE(pc->get_last_error().token.first == ERR_PARSE_DEPTH);
+
+    stringstream str("2;");
+    pc->set_stream(str);
+    REQUIRE(parse_all(r, *pc));
+}
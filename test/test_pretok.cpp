@@ -0,0 +1,299 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+  
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <vector>
+#include <sstream>
+
+#include <tinyparser.hpp>
+
+using namespace std;
+using namespace tipa;
+
+/* A grammar that backtracks: a statement is an assignment, a call
+   or an expression, and the three alternatives start in the same
+   way. */
+struct stmt_grammar {
+    rule expr, primary, call, assign, stmt, root;
+    vector<string> out;
+
+    stmt_grammar() {
+        primary = rule(tk_int) | rule(tk_ident) | (rule('(') >> expr >> rule(')'));
+        expr = primary >> *((rule('+') | rule('-')) >> primary);
+        call = rule(tk_ident) >> rule('(') >> -(expr >> *(rule(',') >> expr)) >> rule(')');
+        assign = rule(tk_ident) >> rule('=') >> expr;
+        stmt = (assign | call | expr) >> rule(';');
+        root = *stmt;
+        stmt.set_action([this](parser_context &pc) {
+                string s;
+                for (auto &t : pc.collect_tokens()) s += t.second + " ";
+                out.push_back(s);
+            });
+    }
+};
+
+static const vector<token> all_tokens = { tk_ident, tk_int };
+
+TEST_CASE("the pretokenized mode gives the same results", "[pretok]")
+{
+    string input =
+        "a = 1 + (b - 2);\n"
+        "f(a, 3 + c, (4));\n"
+        "  x + y - 5 ; g();\n"
+        "h(1)   ;";
+
+    stmt_grammar g1, g2;
+    parser_context pc1, pc2;
+    stringstream s1(input), s2(input);
+    pc1.set_stream(s1);
+    pc2.set_stream(s2);
+    pc2.pretokenize(all_tokens);
+
+    REQUIRE(pc2.is_pretokenized());
+    // the '=', '(' ... become tokens of one character
+    REQUIRE(pc2.token_count() == 38);
+
+    REQUIRE(parse_all(g1.root, pc1));
+    REQUIRE(parse_all(g2.root, pc2));
+    REQUIRE(g1.out.size() == 5);
+    REQUIRE(g1.out == g2.out);
+    REQUIRE(g2.out[1] == "f a 3 c 4 ");
+}
+
+TEST_CASE("literals and tokens in pretokenized mode", "[pretok]")
+{
+    parser_context pc;
+
+    SECTION("a literal can span consecutive tokens") {
+        stringstream str("a == b");
+        pc.set_stream(str);
+        pc.pretokenize(all_tokens);
+        REQUIRE(pc.token_count() == 4);
+        rule r = rule(tk_ident) >> rule("==", true) >> rule(tk_ident);
+        REQUIRE(parse_all(r, pc));
+        auto v = pc.collect_tokens();
+        REQUIRE(v.size() == 3);
+        REQUIRE(v[1].second == "==");
+    }
+    SECTION("but it must be contiguous") {
+        stringstream str("a = = b");
+        pc.set_stream(str);
+        pc.pretokenize(all_tokens);
+        rule r = rule(tk_ident) >> rule("==") >> rule(tk_ident);
+        REQUIRE(not parse_all(r, pc));
+    }
+    SECTION("a token is never split") {
+        stringstream str("iffy");
+        pc.set_stream(str);
+        pc.pretokenize(all_tokens);
+        REQUIRE(not rule("if").parse(pc));
+        REQUIRE(not keyword("if").parse(pc));
+        REQUIRE(keyword("iffy").parse(pc));
+        REQUIRE(pc.eof());
+    }
+    SECTION("a token that is not in the list is matched on the text") {
+        stringstream str("x = 3.25 ;");
+        pc.set_stream(str);
+        pc.pretokenize(all_tokens);
+        rule real = rule(create_lib_token("^\\d+\\.\\d+"));
+        real.as<double>();
+        rule r = rule(tk_ident) >> rule('=') >> real >> rule(';');
+        REQUIRE(parse_all(r, pc));
+        REQUIRE(pc.pop_value<double>() == 3.25);
+    }
+}
+
+TEST_CASE("the ids of the tokens can be far apart", "[pretok]")
+{
+    token word(-5, "[a-z]+");
+    for (token_id id : {7, 1000000}) {
+        token num(id, "[0-9]+");
+        parser_context pc;
+        pc.set_input("x 12 + 3");
+        pc.pretokenize({num, word});
+        rule r = rule(word) >> rule(num) >> rule('+') >> rule(num);
+        REQUIRE(parse_all(r, pc));
+        auto v = pc.collect_tokens();
+        REQUIRE(v.size() == 3);
+        REQUIRE(v[1] == token_val(id, "12"));
+    }
+}
+
+TEST_CASE("positions and errors in pretokenized mode", "[pretok]")
+{
+    string input = "a = 1;\n// a comment\n  b = ;\n";
+    string msg[2];
+    pair<int, int> pos[2];
+    for (int i = 0; i < 2; i++) {
+        stmt_grammar g;
+        stringstream str(input);
+        parser_context pc;
+        pc.set_comment("/*", "*/", "//");
+        pc.set_stream(str);
+        if (i == 1) pc.pretokenize(all_tokens);
+        REQUIRE(not parse_all(g.root, pc));
+        pos[i] = pc.get_pos();
+        msg[i] = pc.get_formatted_err_msg();
+    }
+    REQUIRE(pos[1] == make_pair(3, 2));
+    REQUIRE(pos[0] == pos[1]);
+    REQUIRE(msg[0] == msg[1]);
+}
+
+TEST_CASE("cuts in pretokenized mode", "[pretok]")
+{
+    stringstream str("a 1 b");
+    parser_context pc;
+    pc.set_stream(str);
+    pc.pretokenize(all_tokens);
+
+    rule r = (rule(tk_ident) >> cut() >> rule(tk_ident)) | (rule(tk_ident) >> rule(tk_int));
+    REQUIRE(not r.parse(pc));
+    REQUIRE(pc.is_halted());
+    REQUIRE(pc.get_last_error().token.first == ERR_PARSE_CUT);
+}
+
+TEST_CASE("a cut drops the tokens already parsed", "[pretok]")
+{
+    string input;
+    for (int i = 0; i < 5000; i++) input += "x" + to_string(i) + " = " + to_string(i) + " + y;\n";
+    input += "z = ;\n";
+
+    for (bool pipelined : {false, true}) {
+        stmt_grammar g;
+        rule root = *(g.stmt >> cut());
+        parser_context pc;
+        pc.set_input(input);
+        pc.pretokenize(all_tokens, pipelined);
+        REQUIRE(not parse_all(root, pc));
+        REQUIRE(g.out.size() == 5000);
+        REQUIRE(g.out.back() == "x4999 4999 y ");
+        // 30000 tokens have been parsed
+        REQUIRE(pc.token_count() < 10000);
+        REQUIRE(pc.get_pos() == make_pair(5001, 0));
+        REQUIRE(pc.get_last_error().line == "z = ;");
+    }
+}
+
+TEST_CASE("the rules on the raw text are not available", "[pretok]")
+{
+    stringstream str("{ a } b");
+    parser_context pc;
+    pc.set_stream(str);
+    pc.pretokenize(all_tokens);
+    REQUIRE_THROWS_AS(extract_rule("{", "}").parse(pc), parse_exc);
+}
+
+TEST_CASE("a token matching the empty string is refused", "[pretok]")
+{
+    token digits(100, "[0-9]*");
+    parser_context pc;
+
+    pc.set_input("a b");
+    REQUIRE_THROWS_AS(pc.pretokenize({digits, tk_ident}), parse_exc);
+
+    pc.set_input("a b");
+    pc.pretokenize({digits, tk_ident}, true);
+    REQUIRE_THROWS_AS(parse_all(*rule(digits), pc), parse_exc);
+
+    // it is fine as long as it matches something
+    pc.set_input("12 34");
+    pc.pretokenize({digits, tk_ident});
+    REQUIRE(pc.token_count() == 2);
+}
+
+TEST_CASE("the pipelined mode gives the same results", "[pretok]")
+{
+    string input;
+    for (int i = 0; i < 3000; i++) 
+        input += "x" + to_string(i) + " = (a + " + to_string(i) + ") - b; f(x, " + to_string(i) + ");\n";
+
+    stmt_grammar g1, g2;
+    parser_context pc1, pc2;
+    stringstream s1(input), s2(input);
+    pc1.set_stream(s1);
+    pc2.set_stream(s2);
+    pc1.pretokenize(all_tokens);
+    pc2.pretokenize(all_tokens, true);
+
+    REQUIRE(parse_all(g1.root, pc1));
+    REQUIRE(parse_all(g2.root, pc2));
+    REQUIRE(g1.out.size() == 6000);
+    REQUIRE(g1.out == g2.out);
+    REQUIRE(pc1.token_count() == pc2.token_count());
+    REQUIRE(pc1.get_pos() == pc2.get_pos());
+}
+
+TEST_CASE("positions and errors in pipelined mode", "[pretok]")
+{
+    string input = "a = 1;\n// a comment\n  b = ;\n";
+    string msg[2];
+    for (int i = 0; i < 2; i++) {
+        stmt_grammar g;
+        parser_context pc;
+        pc.set_comment("/*", "*/", "//");
+        pc.set_input(input);
+        pc.pretokenize(all_tokens, i == 1);
+        REQUIRE(not parse_all(g.root, pc));
+        REQUIRE(pc.get_pos() == make_pair(3, 2));
+        msg[i] = pc.get_formatted_err_msg();
+    }
+    REQUIRE(msg[0] == msg[1]);
+}
+
+TEST_CASE("the errors of the lexer thread reach the parser", "[pretok]")
+{
+    string input = "a = 1;\nb = 2; /* not closed\n";
+    stmt_grammar g;
+    parser_context pc;
+    pc.set_comment("/*", "*/", "//");
+
+    pc.set_input(input);
+    REQUIRE_THROWS_AS(pc.pretokenize(all_tokens), parse_exc);
+
+    pc.set_input(input);
+    pc.pretokenize(all_tokens, true);
+    REQUIRE_THROWS_AS(parse_all(g.root, pc), parse_exc);
+}
+
+TEST_CASE("a pipelined parse can be abandoned", "[pretok]")
+{
+    string input;
+    for (int i = 0; i < 20000; i++) input += "a" + to_string(i) + " = " + to_string(i) + ";\n";
+
+    stmt_grammar g;
+    parser_context pc;
+    pc.set_input(input);
+    pc.pretokenize(all_tokens, true);
+    REQUIRE(g.stmt.parse(pc));
+
+    // the lexer thread is stopped
+    pc.set_input("c = 3;");
+    pc.pretokenize(all_tokens, true);
+    REQUIRE(parse_all(g.root, pc));
+    REQUIRE(g.out.back() == "c 3 ");
+
+    // also by the destructor
+    parser_context pc2;
+    pc2.set_input(input);
+    pc2.pretokenize(all_tokens, true);
+}
@@ -0,0 +1,207 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+  
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <chrono>
+#include <ctime>
+
+#include <tinyparser.hpp>
+#include <records.hpp>
+
+using namespace std;
+using namespace tipa;
+
+namespace {
+    string make_input(int n)
+    {
+        string s;
+        for (int i = 0; i < n; i++) {
+            if (i % 7 == 3) s += "broken " + to_string(i) + "\n";
+            else s += "k" + to_string(i) + " = " + to_string(i * 2) + "\n";
+        }
+        return s;
+    }
+
+    struct collected {
+        vector<size_t> index;
+        vector<bool> ok;
+        vector<string> key;
+        long sum = 0;
+    };
+}
+
+TEST_CASE("records are parsed in order", "[records]")
+{
+    rule value = rule(tk_int);
+    value.as<int>();
+    rule line = rule(tk_ident) >> rule('=') >> value;
+    string input = make_input(5000);
+
+    for (unsigned nw : {1u, 4u}) {
+        for (size_t bs : {size_t(64), size_t(1 << 16)}) {
+            record_parser p(line, nw);
+            p.set_block_size(bs);
+            collected c;
+            auto fn = [&c](record_result &r) {
+                c.index.push_back(r.index);
+                c.ok.push_back(r.ok);
+                if (r.ok) {
+                    c.key.push_back(r.tokens.at(0).second);
+                    c.sum += any_cast<int>(r.values.at(0));
+                }
+            };
+
+            REQUIRE(p.parse(string_view(input), fn) == 5000);
+            REQUIRE(c.index.size() == 5000);
+            long sum = 0;
+            for (size_t i = 0; i < 5000; i++) {
+                REQUIRE(c.index[i] == i);
+                REQUIRE(c.ok[i] == (i % 7 != 3));
+                if (i % 7 != 3) sum += 2 * i;
+            }
+            REQUIRE(c.sum == sum);
+            REQUIRE(c.key[0] == "k0");
+            REQUIRE(c.key.back() == "k4999");
+
+            // the same from a stream
+            collected c2;
+            stringstream str(input);
+            auto fn2 = [&c2](record_result &r) {
+                c2.index.push_back(r.index);
+                c2.ok.push_back(r.ok);
+            };
+            REQUIRE(p.parse(str, fn2) == 5000);
+            REQUIRE(c2.index == c.index);
+            REQUIRE(c2.ok == c.ok);
+        }
+    }
+}
+
+TEST_CASE("records and delimiters", "[records]")
+{
+    rule item = rule(tk_ident) >> rule(tk_int);
+    record_parser p(item, 2, ';');
+    p.set_block_size(4);
+
+    vector<string> texts;
+    vector<bool> ok;
+    auto fn = [&](record_result &r) {
+        texts.push_back(string(r.text));
+        ok.push_back(r.ok);
+    };
+
+    SECTION("the last record may not be terminated") {
+        stringstream str("a 1;b 2;;a very_long_identifier 3; c 4");
+        REQUIRE(p.parse(str, fn) == 5);
+        REQUIRE(texts == vector<string>({"a 1", "b 2", "", "a very_long_identifier 3", " c 4"}));
+        REQUIRE(ok == vector<bool>({true, true, false, false, true}));
+    }
+    SECTION("an empty input has no records") {
+        REQUIRE(p.parse(string_view(""), fn) == 0);
+        stringstream str;
+        REQUIRE(p.parse(str, fn) == 0);
+    }
+    SECTION("the errors are reported") {
+        p.parse(string_view("a 1;a b"), [&](record_result &r) {
+                if (!r.ok) texts.push_back(r.error.msg);
+            });
+        REQUIRE(texts.size() == 1);
+    }
+}
+
+TEST_CASE("the contexts of the workers can be configured", "[records]")
+{
+    rule item = rule(tk_ident) >> rule(tk_int);
+    record_parser p(item, 3);
+    p.set_context_setup([](parser_context &pc) { pc.set_comment("/*", "*/", "#"); });
+    int good = 0;
+    REQUIRE(p.parse(string_view("a /* x */ 1\nb 2 # comment\n"), [&good](record_result &r) { good += r.ok; }) == 2);
+    REQUIRE(good == 2);
+}
+
+TEST_CASE("an exception in the callback stops the parsing", "[records]")
+{
+    rule item = rule(tk_ident) >> rule('=') >> rule(tk_int);
+    string input = make_input(20000);
+    record_parser p(item, 4);
+    p.set_block_size(128);
+
+    size_t seen = 0;
+    REQUIRE_THROWS_AS(p.parse(string_view(input), [&seen](record_result &r) {
+                if (++seen == 1000) throw runtime_error("enough");
+            }), runtime_error);
+    REQUIRE(seen == 1000);
+
+    // the parser can be used again
+    REQUIRE(p.parse(string_view(input), [](record_result &) {}) == 20000);
+}
+
+TEST_CASE("an exception in an action stops the parsing", "[records]")
+{
+    rule value = rule(tk_int);
+    value.set_action([](parser_context &pc) {
+            int x = stoi(pc.read_token());
+            // the consumer catches up, and waits for the failing batch
+            if (x > 2900 * 2) this_thread::sleep_for(chrono::microseconds(200));
+            if (x == 3000 * 2) throw runtime_error("bad value");
+            pc.push_value(x);
+        });
+    rule item = rule(tk_ident) >> rule('=') >> value;
+    string input = make_input(10000);
+
+    for (unsigned n : {1u, 3u}) {
+        record_parser p(item, n);
+        p.set_block_size(64);
+        size_t expected = 0;
+        bool in_order = true;
+        REQUIRE_THROWS_AS(p.parse(string_view(input), [&](record_result &r) {
+                    if (r.index != expected++) in_order = false;
+                    if (r.ok && any_cast<int>(r.values.at(0)) != int(r.index) * 2) in_order = false;
+                    if (!r.ok && r.index % 7 != 3) in_order = false;
+                }), runtime_error);
+        REQUIRE(in_order);
+        REQUIRE(expected <= 3000);
+    }
+}
+
+TEST_CASE("the threads sleep while the callback is slow", "[records]")
+{
+    rule item = rule(tk_ident) >> rule('=') >> rule(tk_int);
+    // more batches than the queues can hold
+    string input = make_input(2000);
+    record_parser p(item, 2);
+    p.set_block_size(64);
+
+    clock_t c = clock();
+    size_t n = p.parse(string_view(input), [](record_result &r) {
+            if (r.index % 500 == 0) this_thread::sleep_for(chrono::milliseconds(50));
+        });
+    double cpu = double(clock() - c) / CLOCKS_PER_SEC;
+    REQUIRE(n == 2000);
+    // 200 ms of sleep
+    REQUIRE(cpu < 0.05);
+}
@@ -0,0 +1,128 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include <tinyparser.hpp>
+#include <resumable.hpp>
+
+using namespace std;
+using namespace tipa;
+
+TEST_CASE("resumable parser with chunked input", "[resumable]")
+{
+    vector<pair<string, int>> values;
+    rule item = rule(tk_ident) >> rule('=') >> rule(tk_int) >> -rule(';');
+    item.set_action([&values](parser_context &pc) {
+            pair<string, int> p;
+            read_all(pc, p.first, p.second);
+            values.push_back(p);
+        });
+
+    resumable_parser p(item);
+
+    REQUIRE(p.step() == STEP_NEED_INPUT);
+    p.feed("abc = 1");
+    // the line is not complete yet
+    REQUIRE(p.step() == STEP_NEED_INPUT);
+    p.feed("2;\nde");
+    REQUIRE(p.step() == STEP_ITEM);
+    REQUIRE(values.size() == 1);
+    REQUIRE(p.step() == STEP_NEED_INPUT);
+    p.feed("f = 3\n");
+    // the optional ';' may still come on the next line
+    REQUIRE(p.step() == STEP_NEED_INPUT);
+    REQUIRE(values.size() == 1);
+    p.feed("; g = 4\n");
+    REQUIRE(p.step() == STEP_ITEM);
+    REQUIRE(p.step() == STEP_NEED_INPUT);
+    p.close();
+    REQUIRE(p.step() == STEP_ITEM);
+    REQUIRE(p.step() == STEP_DONE);
+
+    // each action has been invoked exactly once
+    REQUIRE(values.size() == 3);
+    REQUIRE(values[0] == make_pair(string("abc"), 12));
+    REQUIRE(values[1] == make_pair(string("def"), 3));
+    REQUIRE(values[2] == make_pair(string("g"), 4));
+}
+
+TEST_CASE("an item is not parsed again for each chunk", "[resumable]")
+{
+    rule item = rule(tk_ident) >> rule('=') >> sep_list_rule(rule(tk_int)) >> rule(';');
+    resumable_parser p(item);
+
+    p.feed("abc =\n1");
+    REQUIRE(p.step() == STEP_NEED_INPUT);
+    auto steps = p.context().get_steps();
+    for (int i = 0; i < 100; i++) {
+        p.feed(", 2");
+        REQUIRE(p.step() == STEP_NEED_INPUT);
+    }
+    REQUIRE(p.context().get_steps() == steps);
+    p.feed(";\n");
+    REQUIRE(p.step() == STEP_ITEM);
+    REQUIRE(p.context().collect_tokens().size() == 102);
+    p.close();
+    REQUIRE(p.step() == STEP_DONE);
+}
+
+TEST_CASE("resumable parser reports errors", "[resumable]")
+{
+    rule item = rule(tk_ident) >> rule(tk_int);
+    resumable_parser p(item);
+
+    p.feed("abc 12\nabc def\n");
+    REQUIRE(p.step() == STEP_ITEM);
+    REQUIRE(p.step() == STEP_ERROR);
+    REQUIRE(p.context().get_last_error().position.first == 2);
+    REQUIRE(p.step() == STEP_ERROR);
+}
+
+TEST_CASE("multiplexing resumable parsers", "[resumable]")
+{
+    int sum1 = 0, sum2 = 0;
+    rule item1 = rule(tk_int);
+    rule item2 = rule(tk_int);
+    item1.set_action([&sum1](parser_context &pc) { int x; read_all(pc, x); sum1 += x; });
+    item2.set_action([&sum2](parser_context &pc) { int x; read_all(pc, x); sum2 += x; });
+
+    resumable_parser p1(item1), p2(item2);
+    vector<string> chunks = { "1 2 ", "3\n4", "\n5 6\n" };
+    for (auto &c : chunks) {
+        p1.feed(c);
+        p2.feed(c + c);
+        while (p1.step() == STEP_ITEM);
+        while (p2.step() == STEP_ITEM);
+    }
+    p1.close(); p2.close();
+    while (p1.step() == STEP_ITEM);
+    while (p2.step() == STEP_ITEM);
+
+    REQUIRE(p1.step() == STEP_DONE);
+    REQUIRE(p2.step() == STEP_DONE);
+    REQUIRE(sum1 == 1 + 2 + 3 + 4 + 5 + 6);
+    // "3\n43\n4" and "\n5 6\n\n5 6\n" are parsed as 3, 43, 4, 5, 6, 5, 6
+    REQUIRE(sum2 == 1 + 2 + 1 + 2 + 3 + 43 + 4 + 5 + 6 + 5 + 6);
+}
@@ -0,0 +1,102 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <sstream>
+#include <algorithm>
+
+#include <tinyparser.hpp>
+
+using namespace std;
+using namespace tipa;
+
+static string make_input(int n)
+{
+    stringstream str;
+    for (int i = 0; i < n; i++) str << "key" << i << " = " << i << ";\n";
+    return str.str();
+}
+
+TEST_CASE("streaming lexer releases unreachable lines", "[streaming]")
+{
+    size_t max_lines = 0;
+    rule item = rule(tk_ident) >> rule('=') >> rule(tk_int) >> rule(';');
+    item.set_action([&max_lines](parser_context &pc) {
+            max_lines = max(max_lines, pc.retained_lines());
+        });
+    rule root = *item;
+
+    stringstream str(make_input(1000));
+    parser_context pc;
+
+    SECTION("without streaming, all lines are kept") {
+        pc.set_stream(str);
+        REQUIRE(parse_all(root, pc));
+        REQUIRE(max_lines >= 1000);
+    }
+    SECTION("with streaming, only the current item is kept") {
+        pc.set_streaming(true);
+        pc.set_stream(str);
+        REQUIRE(parse_all(root, pc));
+        REQUIRE(max_lines <= 2);
+    }
+}
+
+TEST_CASE("streaming lexer with a bounded lookback", "[streaming]")
+{
+    size_t max_lines = 0;
+    rule item = rule(tk_ident) >> rule('=') >> rule(tk_int) >> rule(';');
+    item.set_action([&max_lines](parser_context &pc) {
+            max_lines = max(max_lines, pc.retained_lines());
+        });
+    parser_context pc;
+
+    SECTION("the first saved context does not keep all lines") {
+        // the sequence keeps a saved context at the beginning
+        rule root = *item >> rule("end");
+        stringstream str(make_input(1000) + "end");
+        pc.set_streaming(true, 10);
+        pc.set_stream(str);
+        REQUIRE(parse_all(root, pc));
+        // the lookback, the current line and the next one
+        REQUIRE(max_lines <= 12);
+    }
+    SECTION("going back too far is an error") {
+        // the first alternative fails on the last line
+        rule root = (*item >> rule("end")) | (*item >> rule("stop"));
+        stringstream str(make_input(1000) + "stop");
+        pc.set_streaming(true, 10);
+        pc.set_stream(str);
+        REQUIRE(not parse_all(root, pc));
+        REQUIRE(pc.is_halted());
+        REQUIRE(pc.get_last_error().token.first == ERR_PARSE_LOOKBACK);
+        // the stacks of the lexer and of the parser are still in sync
+        REQUIRE(pc.saved_depth() == 0);
+    }
+    SECTION("going back within the lookback is fine") {
+        rule root = (*item >> rule("end")) | (*item >> rule("stop"));
+        stringstream str(make_input(5) + "stop");
+        pc.set_streaming(true, 10);
+        pc.set_stream(str);
+        REQUIRE(parse_all(root, pc));
+    }
+}
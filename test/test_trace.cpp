@@ -0,0 +1,157 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+  
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <vector>
+#include <sstream>
+
+#include <tinyparser.hpp>
+
+using namespace std;
+using namespace tipa;
+
+TEST_CASE("the tracer is disabled by default", "[trace]")
+{
+    rule r = rule(tk_ident) >> rule('=') >> rule(tk_int);
+    stringstream str("a = 1");
+    parser_context pc;
+    pc.set_stream(str);
+    REQUIRE(not pc.tracing());
+    REQUIRE(parse_all(r, pc));
+    REQUIRE(pc.trace_events() == 0);
+    REQUIRE(pc.get_trace().empty());
+}
+
+TEST_CASE("the events of the rules", "[trace]")
+{
+    rule id = rule(tk_ident);
+    rule num = rule(tk_int);
+    rule r = id >> rule('=') >> (id | num);
+
+    for (auto engine : {ENGINE_RECURSIVE, ENGINE_ITERATIVE}) {
+        stringstream str("a = 12");
+        parser_context pc;
+        pc.set_trace(100);
+        pc.set_engine(engine);
+        pc.set_stream(str);
+        REQUIRE(parse_all(r, pc));
+
+        auto v = pc.get_trace();
+        REQUIRE(v.size() == pc.trace_events());
+        // each rule is entered and left once
+        int enter = 0, leave = 0;
+        for (auto &e : v) {
+            if (e.kind == TRACE_ENTER) enter++;
+            else leave++;
+        }
+        REQUIRE(enter == leave);
+
+        REQUIRE(v.front().kind == TRACE_ENTER);
+        REQUIRE(v.front().depth == 1);
+        REQUIRE(v.back().kind == TRACE_EXIT);
+        REQUIRE(v.front().rule == r.get_pimpl().get());
+        REQUIRE(v.back().rule == v.front().rule);
+
+        // the second id fails on "12", then num succeeds
+        vector<const trace_event *> ids;
+        for (auto &e : v) 
+            if (e.rule == id.get_pimpl().get() && e.kind != TRACE_ENTER) ids.push_back(&e);
+        REQUIRE(ids.size() == 2);
+        REQUIRE(ids[0]->kind == TRACE_EXIT);
+        REQUIRE(ids[1]->kind == TRACE_FAIL);
+        REQUIRE(ids[1]->line == 1);
+        REQUIRE(ids[1]->col == 4);
+
+        for (size_t i = 1; i < v.size(); i++) REQUIRE(v[i - 1].time <= v[i].time);
+    }
+}
+
+TEST_CASE("the ring keeps the last events", "[trace]")
+{
+    rule r = *rule(tk_int);
+    string input;
+    for (int i = 0; i < 1000; i++) input += to_string(i) + " ";
+
+    stringstream str(input);
+    parser_context pc;
+    pc.set_trace(16);
+    pc.set_stream(str);
+    REQUIRE(parse_all(r, pc));
+    REQUIRE(pc.trace_events() > 2000);
+
+    auto v = pc.get_trace();
+    REQUIRE(v.size() == 16);
+    REQUIRE(v.back().kind == TRACE_EXIT);
+    REQUIRE(v.back().depth == 1);
+
+    ostringstream os;
+    pc.dump_trace(os);
+    REQUIRE(os.str().find("older events dropped") != string::npos);
+
+    // set_stream() starts a new trace
+    stringstream str2("1 2");
+    pc.set_stream(str2);
+    REQUIRE(pc.trace_events() == 0);
+    REQUIRE(parse_all(r, pc));
+    REQUIRE(pc.get_trace().size() == pc.trace_events());
+
+    pc.set_trace(0);
+    REQUIRE(not pc.tracing());
+}
+
+TEST_CASE("the trace is dumped on failure", "[trace]")
+{
+    rule r = rule(tk_ident) >> rule('=') >> rule(tk_int) >> rule(';');
+    ostringstream os;
+    parser_context pc;
+    pc.set_trace(TIPA_TRACE_EVENTS, &os);
+
+    stringstream ok("a = 1;");
+    pc.set_stream(ok);
+    REQUIRE(parse_all(r, pc));
+    REQUIRE(os.str().empty());
+
+    stringstream bad("a = b;");
+    pc.set_stream(bad);
+    REQUIRE(not parse_all(r, pc));
+    string s = os.str();
+    REQUIRE(s.find("enter") != string::npos);
+    REQUIRE(s.find("fail") != string::npos);
+}
+
+TEST_CASE("tracing a pretokenized input", "[trace]")
+{
+    rule r = *(rule(tk_ident) >> rule('=') >> rule(tk_int) >> rule(';'));
+    stringstream str("a = 1;\nbb = 2;");
+    parser_context pc;
+    pc.set_trace();
+    pc.set_stream(str);
+    pc.pretokenize({tk_ident, tk_int});
+    REQUIRE(parse_all(r, pc));
+
+    auto v = pc.get_trace();
+    REQUIRE(not v.empty());
+    bool second_line = false;
+    for (auto &e : v) if (e.line == 2 && e.col == 3) second_line = true;
+    REQUIRE(second_line);
+}
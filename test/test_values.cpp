@@ -0,0 +1,119 @@
+/*
+  Copyright 2015-2018 Giuseppe Lipari
+  email: giuseppe.lipari@univ-lille.fr
+
+  This file is part of TiPa.
+
+  TiPa is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  TiPa is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+  License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with TiPa. If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <sstream>
+#include <memory>
+#include <cstdint>
+
+#include <tinyparser.hpp>
+
+using namespace std;
+using namespace tipa;
+
+TEST_CASE("terminals produce typed values", "[values]")
+{
+    stringstream str("x = 12345678901 , 2.5");
+    parser_context pc;
+    pc.set_stream(str);
+
+    rule name = rule(tk_ident);
+    rule big = rule(tk_int);
+    rule real = rule(create_lib_token("^\\d+\\.\\d+"));
+    name.as<string>();
+    big.as<int64_t>();
+    real.as<double>();
+
+    rule r = name >> rule('=') >> big >> rule(',') >> real;
+    REQUIRE(parse_all(r, pc));
+    REQUIRE(pc.value_count() == 3);
+    REQUIRE(pc.pop_value<double>() == 2.5);
+    REQUIRE(pc.pop_value<int64_t>() == 12345678901LL);
+    REQUIRE(pc.pop_value<string>() == "x");
+    // nothing has been collected
+    REQUIRE(pc.collect_tokens().empty());
+}
+
+TEST_CASE("actions combine the values of the children", "[values]")
+{
+    struct node {
+        int v;
+        shared_ptr<node> l, r;
+    };
+    typedef shared_ptr<node> pnode;
+
+    rule expr, primary, num;
+    num = rule(tk_int);
+    num.as<int>().set_action(combine<pnode, int>([](int v) { return make_shared<node>(node{v, nullptr, nullptr}); }));
+    primary = num | (rule('(') >> expr >> rule(')'));
+    expr = operator_table_rule(primary, {
+            {'+', OP_LEFT, 1, combine<pnode, pnode, pnode>([](pnode a, pnode b) { return make_shared<node>(node{'+', a, b}); })},
+            {'-', OP_LEFT, 1, combine<pnode, pnode, pnode>([](pnode a, pnode b) { return make_shared<node>(node{'-', a, b}); })}
+        });
+
+    stringstream str("1 - (2 + 3)");
+    parser_context pc;
+    pc.set_stream(str);
+    REQUIRE(parse_all(expr, pc));
+    REQUIRE(pc.value_count() == 1);
+    auto t = pc.pop_value<pnode>();
+    REQUIRE(t->v == '-');
+    REQUIRE(t->l->v == 1);
+    REQUIRE(t->r->v == '+');
+    REQUIRE(t->r->r->v == 3);
+}
+
+TEST_CASE("values are restored on backtracking", "[values]")
+{
+    rule num = rule(tk_int);
+    num.as<int>();
+    rule sum = num >> rule('+') >> num;
+    sum.set_action(combine<int, int, int>([](int a, int b) { return a + b; }));
+
+    // the first alternative consumes both values and then fails
+    rule r = (sum >> rule(';')) | (num >> rule('+') >> num >> rule('.'));
+
+    stringstream str("3 + 4 .");
+    parser_context pc;
+    pc.set_stream(str);
+    REQUIRE(parse_all(r, pc));
+    REQUIRE(pc.value_count() == 2);
+    REQUIRE(pc.peek_value<int>(0) == 4);
+    REQUIRE(pc.peek_value<int>(1) == 3);
+    REQUIRE_THROWS_AS(pc.peek_value<string>(), parse_exc);
+    REQUIRE_THROWS_AS(pc.peek_value<int>(2), parse_exc);
+}
+
+TEST_CASE("conversion errors", "[values]")
+{
+    rule num = rule(tk_int);
+    num.as<int8_t>();
+    stringstream str("300");
+    parser_context pc;
+    pc.set_stream(str);
+    REQUIRE(!parse_all(num, pc));
+    REQUIRE(pc.get_last_error().token.first == ERR_PARSE_CONV);
+    REQUIRE(pc.value_count() == 0);
+
+    rule seq = rule(tk_int) >> rule(tk_int);
+    REQUIRE_THROWS_AS(seq.as<int>(), parse_exc);
+}